@@ -0,0 +1,286 @@
+#include "async_hash.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "multibuffer.h"
+#include "streebog.h"
+
+namespace async_hash {
+
+namespace {
+
+/**
+ * Большие задания хешируются шагами такого размера; между шагами проверяется отмена.
+ */
+const size_t cancel_step = 4 << 20;
+
+template<size_t hash_bits>
+bool hash_step_by_step(const uint8_t *data, size_t length, uint8_t *out, const std::function<bool()> &cancelled) {
+    Streebog<hash_bits> context;
+    for (size_t offset = 0; offset < length; offset += cancel_step) {
+        if (offset > 0 && cancelled()) {
+            return false;
+        }
+        context.update(data + offset, std::min(cancel_step, length - offset));
+    }
+    context.final(out);
+    return true;
+}
+
+void signal(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+};
+
+Hasher::Hasher(const Options &options) : options_(options) {
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    auto threads = options.threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.threads;
+    for (size_t i = 0; i < threads; i++) {
+        workers_.emplace_back([this] { work(); });
+    }
+}
+
+Hasher::~Hasher() {
+    std::deque<Job> queued;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queued.swap(queue_);
+        cancelled_.insert(running_.begin(), running_.end());
+    }
+    has_jobs_.notify_all();
+    has_space_.notify_all();
+    for (auto &job : queued) {
+        if (job.has_promise) {
+            job.promise.set_value({job.id, status_cancelled, job.hash_bits, {}, nullptr});
+        }
+    }
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+    if (event_fd_ >= 0) {
+        close(event_fd_);
+    }
+}
+
+Job_id Hasher::try_submit(const uint8_t *data, size_t length, size_t hash_bits, Callback callback, void *user_data) {
+    return enqueue({0, data, length, hash_bits, std::move(callback), user_data, {}, false}, false);
+}
+
+Job_id Hasher::submit(const uint8_t *data, size_t length, size_t hash_bits, Callback callback, void *user_data) {
+    return enqueue({0, data, length, hash_bits, std::move(callback), user_data, {}, false}, true);
+}
+
+std::future<Completion> Hasher::submit_future(const uint8_t *data, size_t length, size_t hash_bits) {
+    Job job = {0, data, length, hash_bits, nullptr, nullptr, {}, true};
+    auto future = job.promise.get_future();
+    if (enqueue(std::move(job), true) == 0) {
+        std::promise<Completion> rejected;
+        rejected.set_value({0, status_cancelled, hash_bits, {}, nullptr});
+        return rejected.get_future();
+    }
+    return future;
+}
+
+Job_id Hasher::enqueue(Job job, bool wait) {
+    if (job.hash_bits != 256 && job.hash_bits != 512) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto fits = [&] {
+        return stopping_ || jobs_ == 0 ||
+               (jobs_ < options_.max_jobs && bytes_ + job.length <= options_.max_bytes);
+    };
+    if (wait) {
+        has_space_.wait(lock, fits);
+    }
+    if (stopping_ || !fits()) {
+        return 0;
+    }
+    job.id = next_id_++;
+    jobs_++;
+    bytes_ += job.length;
+    auto id = job.id;
+    queue_.push_back(std::move(job));
+    lock.unlock();
+    has_jobs_.notify_one();
+    return id;
+}
+
+bool Hasher::cancel(Job_id id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto queued = std::find_if(queue_.begin(), queue_.end(), [id](const Job &job) { return job.id == id; });
+    if (queued == queue_.end()) {
+        if (running_.count(id) == 0) {
+            return false;
+        }
+        cancelled_.insert(id);
+        return true;
+    }
+
+    std::vector<Job> batch;
+    batch.push_back(std::move(*queued));
+    queue_.erase(queued);
+    lock.unlock();
+
+    std::vector<Completion> results(1);
+    results[0] = {id, status_cancelled, batch[0].hash_bits, {}, batch[0].user_data};
+    finish(batch, results);
+    return true;
+}
+
+void Hasher::work() {
+    std::vector<Job> batch;
+    std::vector<Completion> results;
+    auto lanes = std::max<size_t>(1, multibuffer::lanes());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        has_jobs_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+
+        // короткие задания с тем же размером дайджеста забираются пачкой на все линии вектора
+        batch.clear();
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+        if (batch[0].length <= options_.batch_max_length) {
+            while (batch.size() < lanes && !queue_.empty() && queue_.front().length <= options_.batch_max_length &&
+                   queue_.front().hash_bits == batch[0].hash_bits) {
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+        }
+        for (const auto &job : batch) {
+            running_.insert(job.id);
+        }
+        lock.unlock();
+
+        compute(batch, results);
+        finish(batch, results);
+
+        lock.lock();
+    }
+}
+
+bool Hasher::cancel_requested(Job_id id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_.count(id) != 0;
+}
+
+void Hasher::compute(std::vector<Job> &batch, std::vector<Completion> &results) {
+    results.resize(batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        results[i] = {batch[i].id, status_ok, batch[i].hash_bits, {}, batch[i].user_data};
+    }
+
+    if (batch.size() > 1) {
+        const uint8_t *messages[64];
+        size_t lengths[64];
+        uint8_t digests[64 * 64];
+        auto digest_size = batch[0].hash_bits / 8;
+        for (size_t i = 0; i < batch.size(); i++) {
+            messages[i] = batch[i].data;
+            lengths[i] = batch[i].length;
+        }
+        multibuffer::hash_many(messages, lengths, batch.size(), digests, batch[0].hash_bits);
+        for (size_t i = 0; i < batch.size(); i++) {
+            std::copy_n(digests + i * digest_size, digest_size, results[i].digest.begin());
+        }
+        return;
+    }
+
+    const auto &job = batch[0];
+    auto cancelled = [this, &job] { return cancel_requested(job.id); };
+    bool done = job.hash_bits == 256
+                ? hash_step_by_step<256>(job.data, job.length, results[0].digest.data(), cancelled)
+                : hash_step_by_step<512>(job.data, job.length, results[0].digest.data(), cancelled);
+    if (!done) {
+        results[0].status = status_cancelled;
+    }
+}
+
+void Hasher::finish(std::vector<Job> &batch, std::vector<Completion> &results) {
+    bool posted = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < batch.size(); i++) {
+            running_.erase(batch[i].id);
+            if (cancelled_.erase(batch[i].id) != 0) {
+                results[i].status = status_cancelled;
+                results[i].digest = {};
+            }
+            if (!batch[i].has_promise) {
+                completions_.push_back({std::move(batch[i].callback), results[i], batch[i].length});
+                posted = true;
+            }
+        }
+    }
+    if (posted && event_fd_ >= 0) {
+        signal(event_fd_);
+    }
+
+    // future получает результат сразу, его место освобождается без poll()
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (batch[i].has_promise) {
+            batch[i].promise.set_value(results[i]);
+            release(batch[i].length);
+        }
+    }
+}
+
+void Hasher::release(size_t length) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_--;
+        bytes_ -= length;
+    }
+    has_space_.notify_all();
+}
+
+size_t Hasher::poll() {
+    uint64_t counter;
+    if (event_fd_ >= 0) {
+        while (read(event_fd_, &counter, sizeof(counter)) < 0 && errno == EINTR) {
+        }
+    }
+
+    std::deque<Ready> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready.swap(completions_);
+    }
+    for (auto &entry : ready) {
+        if (entry.callback) {
+            entry.callback(entry.completion);
+        }
+    }
+
+    // место освобождается после выдачи, иначе невыбранные завершения копились бы без предела
+    if (!ready.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto &entry : ready) {
+                jobs_--;
+                bytes_ -= entry.length;
+            }
+        }
+        has_space_.notify_all();
+    }
+    return ready.size();
+}
+
+size_t Hasher::in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_;
+}
+
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Асинхронное хеширование для событийных циклов: задания (буфер и обработчик или future) уходят
+ * в пул потоков библиотеки, а о завершении сообщает eventfd. Поток реактора добавляет event_fd()
+ * в свой epoll / poll и, когда дескриптор становится читаемым, вызывает poll() -- обработчики
+ * выполняются в этом же потоке, поэтому им не нужны блокировки.
+ *
+ * Буфер задания должен жить до его завершения. Короткие задания одного размера дайджеста
+ * рабочий поток забирает пачкой и хеширует многобуферным движком.
+ */
+namespace async_hash {
+
+using Job_id = uint64_t;
+
+enum Status : uint8_t {
+    status_ok = 0,
+    status_cancelled = 1
+};
+
+struct Completion {
+    Job_id id;
+    Status status;
+    size_t hash_bits;
+    std::array<uint8_t, 64> digest;     // первые hash_bits / 8 байт
+    void *user_data;
+};
+
+using Callback = std::function<void(const Completion &)>;
+
+struct Options {
+    size_t threads = 0;                     // 0 -- по числу процессоров
+    size_t max_jobs = 1024;                 // незавершённых заданий (включая не выданные poll)
+    size_t max_bytes = 256 << 20;           // их суммарный объём; одно большее задание допускается
+    size_t batch_max_length = 4096;         // задания до этой длины хешируются пачками
+};
+
+class Hasher {
+public:
+    explicit Hasher(const Options &options = Options());
+    Hasher(const Hasher &) = delete;
+    Hasher &operator=(const Hasher &) = delete;
+
+    /**
+     * Ожидающие задания отменяются, выполняемые прерываются; их обработчики уже не вызываются.
+     */
+    ~Hasher();
+
+    /**
+     * Дескриптор, читаемый при наличии завершений; -1, если eventfd создать не удалось.
+     */
+    int event_fd() const {
+        return event_fd_;
+    }
+
+    /**
+     * Неблокирующая отправка: 0, если достигнут предел max_jobs / max_bytes или hash_bits неверен.
+     * Подходит для потока реактора.
+     */
+    Job_id try_submit(const uint8_t *data, size_t length, size_t hash_bits, Callback callback,
+                      void *user_data = nullptr);
+
+    /**
+     * Ждёт свободного места. Нельзя вызывать из потока, который сам выполняет poll(): места
+     * освобождаются только после выдачи завершений.
+     */
+    Job_id submit(const uint8_t *data, size_t length, size_t hash_bits, Callback callback,
+                  void *user_data = nullptr);
+
+    /**
+     * Результат через future, без eventfd и poll(); ждёт свободного места, как submit.
+     */
+    std::future<Completion> submit_future(const uint8_t *data, size_t length, size_t hash_bits);
+
+    /**
+     * Ожидающее задание снимается сразу, выполняемое прерывается на ближайшей границе шага;
+     * в обоих случаях завершение приходит со status_cancelled. false, если задание уже завершено.
+     */
+    bool cancel(Job_id id);
+
+    /**
+     * Сбрасывает eventfd и вызывает обработчики готовых заданий; возвращает их число.
+     */
+    size_t poll();
+
+    /**
+     * Незавершённые задания, включая готовые, но ещё не выданные poll().
+     */
+    size_t in_flight() const;
+
+private:
+    struct Job {
+        Job_id id;
+        const uint8_t *data;
+        size_t length;
+        size_t hash_bits;
+        Callback callback;
+        void *user_data;
+        std::promise<Completion> promise;
+        bool has_promise;
+    };
+
+    struct Ready {
+        Callback callback;
+        Completion completion;
+        size_t length;
+    };
+
+    Job_id enqueue(Job job, bool wait);
+    void work();
+    void compute(std::vector<Job> &batch, std::vector<Completion> &results);
+    bool cancel_requested(Job_id id);
+    void finish(std::vector<Job> &batch, std::vector<Completion> &results);
+    void release(size_t length);
+
+    Options options_;
+    int event_fd_ = -1;
+
+    mutable std::mutex mutex_;
+    std::condition_variable has_jobs_;
+    std::condition_variable has_space_;
+    std::deque<Job> queue_;
+    std::unordered_set<Job_id> running_;
+    std::unordered_set<Job_id> cancelled_;
+    std::deque<Ready> completions_;
+    Job_id next_id_ = 1;
+    size_t jobs_ = 0;
+    size_t bytes_ = 0;
+    bool stopping_ = false;
+
+    std::vector<std::thread> workers_;
+};
+
+};
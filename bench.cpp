@@ -0,0 +1,447 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/utsname.h>
+
+#include "compression.h"
+#include "drbg.h"
+#include "hmac.h"
+#include "kernels.h"
+#include "multibuffer.h"
+#include "perf_counters.h"
+#include "stribog_hash.h"
+#include "streebog.h"
+
+/**
+ * Бенчмарк Streebog: пути single (один вызов hash), streaming (update кусками по 1000 байт,
+ * чтобы работал буфер неполного блока) и batched (multibuffer::hash_many) на размерах от 0 B
+ * до 1 GiB, цепочки хешей фиксированной длины, HMAC и PBKDF2, генератор Hash_DRBG, а также
+ * микробенчмарки отдельных преобразований.
+ *
+ * Каждый замер повторяется, пока не займёт --min-time секунд, из --repeat замеров берётся лучший.
+ * Такты -- аппаратный счётчик циклов, если perf_event доступен, иначе такты TSC.
+ * GB/s -- 10^9 байт в секунду.
+ */
+namespace {
+
+struct Options {
+    size_t hash_bits = 256;
+    uint64_t max_size = 1ULL << 30;
+    double min_time = 0.2;
+    size_t repeat = 3;
+    std::string filter;
+    std::string json_path;
+};
+
+struct Measurement {
+    std::string group;
+    std::string name;
+    uint64_t size = 0;          // байт за одну операцию, 0 для микробенчмарков
+    uint64_t operations = 0;
+    double seconds = 0;
+    uint64_t tsc_ticks = 0;
+    perf::Counters counters;
+
+    double cycles() const {
+        return counters.valid[perf::cycles] ? (double)counters.values[perf::cycles] : (double)tsc_ticks;
+    }
+};
+
+volatile uint8_t sink;
+
+#ifdef __OPTIMIZE__
+const bool optimized_build = true;
+#else
+const bool optimized_build = false;
+#endif
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [-a 256|512] [--max-size N] [--min-time SEC] [--repeat N]" << std::endl
+              << "       " << program << " [--filter TEXT] [--json FILE]" << std::endl
+              << std::endl
+              << "  -a BITS         digest size, 256 (default) or 512" << std::endl
+              << "  --max-size N    largest message in the size sweep (default 1073741824)" << std::endl
+              << "  --min-time SEC  minimal duration of one measurement (default 0.2)" << std::endl
+              << "  --repeat N      measurements per case, the best one is reported (default 3)" << std::endl
+              << "  --filter TEXT   run only cases whose \"group/name\" contains TEXT" << std::endl
+              << "  --json FILE     also write results as JSON to FILE (- for standard output)" << std::endl;
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << argv[0] << ": unknown option or missing value " << arg << std::endl;
+            return false;
+        }
+        if (arg == "-a") {
+            options.hash_bits = strtoul(argv[++i], nullptr, 10);
+            if (options.hash_bits != 256 && options.hash_bits != 512) {
+                std::cerr << argv[0] << ": unsupported digest size " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--max-size") {
+            options.max_size = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--min-time") {
+            options.min_time = strtod(argv[++i], nullptr);
+        } else if (arg == "--repeat") {
+            options.repeat = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--filter") {
+            options.filter = argv[++i];
+        } else if (arg == "--json") {
+            options.json_path = argv[++i];
+        } else {
+            std::cerr << argv[0] << ": unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Operation>
+Measurement run(perf::Counter_group &counters, uint64_t operations, Operation &operation) {
+    Measurement result;
+    result.operations = operations;
+
+    auto time_begin = std::chrono::steady_clock::now();
+    counters.start();
+    auto tsc_begin = perf::read_tsc();
+    for (uint64_t i = 0; i < operations; i++) {
+        operation();
+    }
+    result.tsc_ticks = perf::read_tsc() - tsc_begin;
+    result.counters = counters.stop();
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - time_begin;
+    result.seconds = seconds.count();
+    return result;
+}
+
+/**
+ * Подбирает число операций на --min-time и возвращает лучший из --repeat замеров.
+ */
+template<typename Operation>
+Measurement measure(perf::Counter_group &counters, const Options &options, Operation operation) {
+    uint64_t operations = 1;
+    auto best = run(counters, operations, operation);
+    while (best.seconds < options.min_time) {
+        auto scale = best.seconds <= 0 ? 10.0 : std::min(10.0, 1.2 * options.min_time / best.seconds);
+        operations = std::max<uint64_t>(operations + 1, (uint64_t)((double)operations * scale));
+        best = run(counters, operations, operation);
+    }
+    for (size_t i = 1; i < options.repeat; i++) {
+        auto candidate = run(counters, operations, operation);
+        if (candidate.seconds < best.seconds) {
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+class Suite {
+public:
+    Suite(const Options &options, std::ostream &table) : options_(options), table_(table) {
+    }
+
+    bool enabled(const std::string &group, const std::string &name) const {
+        return options_.filter.empty() || (group + "/" + name).find(options_.filter) != std::string::npos;
+    }
+
+    template<typename Operation>
+    void add(const std::string &group, const std::string &name, uint64_t size, Operation operation) {
+        if (!enabled(group, name)) {
+            return;
+        }
+        auto result = measure(counters_, options_, operation);
+        result.group = group;
+        result.name = name;
+        result.size = size;
+        print(result);
+        results_.push_back(result);
+    }
+
+    void print_header() const {
+        table_ << "counters: " << (counters_.available() ? "perf_event" : "unavailable, cycles are TSC ticks")
+               << ", kernel: " << kernels::active().name << ", multibuffer lanes: " << multibuffer::lanes()
+               << (optimized_build ? "" : ", UNOPTIMIZED BUILD (use -DCMAKE_BUILD_TYPE=Release)")
+               << std::endl << std::endl
+               << std::left << std::setw(10) << "group" << std::setw(28) << "name" << std::right
+               << std::setw(12) << "size" << std::setw(14) << "ns/op" << std::setw(12) << "cycles/op"
+               << std::setw(12) << "cycles/B" << std::setw(10) << "GB/s" << std::setw(8) << "IPC"
+               << std::setw(14) << "misses/op" << std::endl;
+    }
+
+    void write_json(std::ostream &out) const;
+
+private:
+    void print(const Measurement &result) const {
+        auto operations = (double)result.operations;
+        auto bytes = (double)result.size * operations;
+        table_ << std::left << std::setw(10) << result.group << std::setw(28) << result.name << std::right
+               << std::setw(12) << result.size << std::fixed << std::setprecision(1)
+               << std::setw(14) << result.seconds * 1e9 / operations
+               << std::setw(12) << result.cycles() / operations << std::setprecision(2);
+        if (bytes > 0) {
+            table_ << std::setw(12) << result.cycles() / bytes << std::setw(10) << bytes / result.seconds / 1e9;
+        } else {
+            table_ << std::setw(12) << "-" << std::setw(10) << "-";
+        }
+        const auto &counters = result.counters;
+        if (counters.valid[perf::cycles] && counters.valid[perf::instructions] && counters.values[perf::cycles] > 0) {
+            table_ << std::setw(8) << (double)counters.values[perf::instructions] / counters.values[perf::cycles];
+        } else {
+            table_ << std::setw(8) << "-";
+        }
+        if (counters.valid[perf::cache_misses]) {
+            table_ << std::setw(14) << (double)counters.values[perf::cache_misses] / operations;
+        } else {
+            table_ << std::setw(14) << "-";
+        }
+        table_ << std::defaultfloat << std::endl;
+    }
+
+    const Options &options_;
+    std::ostream &table_;
+    perf::Counter_group counters_;
+    std::vector<Measurement> results_;
+};
+
+void Suite::write_json(std::ostream &out) const {
+    utsname system;
+    uname(&system);
+
+    out << "{\n  \"system\": {\"kernel\": \"" << system.release << "\", \"machine\": \"" << system.machine
+        << "\", \"g_kernel\": \"" << kernels::active().name << "\", \"multibuffer_lanes\": " << multibuffer::lanes()
+        << ", \"optimized\": " << (optimized_build ? "true" : "false")
+        << ", \"hardware_counters\": " << (counters_.available() ? "true" : "false") << "},\n"
+        << "  \"hash_bits\": " << options_.hash_bits << ",\n  \"results\": [";
+    out << std::setprecision(10);
+    for (size_t i = 0; i < results_.size(); i++) {
+        const auto &result = results_[i];
+        auto operations = (double)result.operations;
+        auto bytes = (double)result.size * operations;
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"group\": \"" << result.group << "\", \"name\": \"" << result.name << "\", \"size\": "
+            << result.size << ", \"operations\": " << result.operations << ", \"seconds\": " << result.seconds
+            << ", \"ns_per_op\": " << result.seconds * 1e9 / operations
+            << ", \"cycles_per_op\": " << result.cycles() / operations
+            << ", \"cycle_source\": \"" << (result.counters.valid[perf::cycles] ? "perf" : "tsc") << "\"";
+        if (bytes > 0) {
+            out << ", \"cycles_per_byte\": " << result.cycles() / bytes
+                << ", \"gb_per_s\": " << bytes / result.seconds / 1e9;
+        } else {
+            out << ", \"cycles_per_byte\": null, \"gb_per_s\": null";
+        }
+        out << ", \"counters\": ";
+        if (result.counters.any()) {
+            out << "{";
+            for (int event = 0; event < perf::event_count; event++) {
+                out << (event == 0 ? "\"" : ", \"") << perf::event_name((perf::Event)event) << "\": ";
+                if (result.counters.valid[event]) {
+                    out << result.counters.values[event];
+                } else {
+                    out << "null";
+                }
+            }
+            out << "}";
+        } else {
+            out << "null";
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+const uint64_t sizes[] = {0, 1, 32, 63, 64, 65, 128, 256, 512, 1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10,
+                          1 << 20, 4 << 20, 16 << 20, 64 << 20, 256 << 20, 1ULL << 30};
+
+/**
+ * Пакетный путь имеет смысл для коротких независимых сообщений; выше этого размера не замеряется.
+ */
+const uint64_t max_batched_size = 64 << 10;
+const size_t batch_messages = 64;
+
+/**
+ * Цепочка хешей: вход каждого звена -- результат предыдущего (32 или 64 байта).
+ */
+template<size_t hash_bits>
+void run_chain(Suite &suite) {
+    using Hash = Streebog<hash_bits>;
+    typename Hash::digest_t link = {};
+
+    suite.add("chain", std::to_string(Hash::digest_size) + "/fixed", Hash::digest_size, [&] {
+        link = Hash::hash(link);
+    });
+    suite.add("chain", std::to_string(Hash::digest_size) + "/generic", Hash::digest_size, [&] {
+        link = Hash::hash(link.data(), link.size());
+    });
+    sink = link[0];
+}
+
+template<size_t hash_bits>
+void run_sweep(Suite &suite, const Options &options, const std::vector<uint8_t> &data) {
+    using Hash = Streebog<hash_bits>;
+    uint8_t digest[Hash::digest_size];
+    std::vector<uint8_t> batch_digests(batch_messages * Hash::digest_size);
+
+    for (auto size : sizes) {
+        if (size > options.max_size) {
+            break;
+        }
+        auto name = std::to_string(size);
+
+        suite.add("single", name, size, [&] {
+            Hash::hash(data.data(), size, digest);
+            sink = digest[0];
+        });
+
+        suite.add("streaming", name, size, [&] {
+            Hash context;
+            for (uint64_t offset = 0; offset < size; offset += 1000) {
+                context.update(data.data() + offset, std::min<uint64_t>(1000, size - offset));
+            }
+            context.final(digest);
+            sink = digest[0];
+        });
+
+        if (size <= max_batched_size) {
+            std::vector<const uint8_t *> messages(batch_messages);
+            std::vector<size_t> lengths(batch_messages, size);
+            for (size_t i = 0; i < batch_messages; i++) {
+                messages[i] = data.data() + (i * size) % (data.size() - size + 1);
+            }
+            suite.add("batched", name + "x" + std::to_string(batch_messages), size * batch_messages, [&] {
+                multibuffer::hash_many(messages.data(), lengths.data(), batch_messages, batch_digests.data(),
+                                       hash_bits);
+                sink = batch_digests[0];
+            });
+        }
+    }
+}
+
+void run_micro(Suite &suite) {
+    Stribog_hash reference({0, 0, 0, 0}, Stribog_hash::Backend::reference);
+    __uint512_t block = {0x0123456789abcdefULL, 0xfedcba9876543210ULL, 0x55, 0xaa};
+    const __uint512_t zero = {0, 0, 0, 0};
+
+    suite.add("micro", "s_conversion", 0, [&] { block = reference.s_conversion(block); });
+    suite.add("micro", "p_conversion", 0, [&] { block = reference.p_conversion(block); });
+    suite.add("micro", "l_conversion", 0, [&] { block = reference.l_conversion(block); });
+    suite.add("micro", "e_function", 0, [&] { block = reference.e_function(block, block); });
+    suite.add("micro", "g_function", 0, [&] { block = reference.g_function(block, block, zero); });
+    sink = (uint8_t)block[0];
+
+    compression::state_t state = compression::from_uint512(block);
+    const compression::state_t N = {};
+    suite.add("micro", "table/lps", 0, [&] { state = compression::lps(state); });
+    suite.add("micro", "table/e_function", 0, [&] { state = compression::e_function(state, state); });
+    suite.add("micro", "table/g_function", 0, [&] { state = compression::g_function(state, state, N); });
+
+    size_t count;
+    auto all = kernels::all(count);
+    for (size_t i = 0; i < count; i++) {
+        if (all[i].supported()) {
+            auto g = all[i].g_function;
+            suite.add("micro", std::string("kernel/") + all[i].name + "/g_function", 0,
+                      [&] { state = g(state, state, N); });
+        }
+    }
+    sink = (uint8_t)state[0];
+}
+
+/**
+ * HMAC: имитовставка сообщения длиной в дайджест (вход -- предыдущая имитовставка) с заранее
+ * установленным ключом. PBKDF2-512: одна операция -- 1000 итераций, ns/op / 1000 -- время итерации.
+ */
+void run_hmac(Suite &suite) {
+    uint8_t key[32] = {3};
+    uint8_t tag[64] = {};
+
+    Hmac_256 hmac_256(key, sizeof(key));
+    suite.add("hmac", "256/32", 32, [&] {
+        hmac_256.mac(tag, 32, tag);
+        sink = tag[0];
+    });
+    Hmac_512 hmac_512(key, sizeof(key));
+    suite.add("hmac", "512/64", 64, [&] {
+        hmac_512.mac(tag, 64, tag);
+        sink = tag[0];
+    });
+
+    const uint64_t iterations = 1000;
+    suite.add("hmac", "pbkdf2-512/" + std::to_string(iterations), 0, [&] {
+        pbkdf2<512>((const uint8_t *)"password", 8, (const uint8_t *)"salt", 4, iterations, tag, sizeof(tag));
+        sink = tag[0];
+    });
+}
+
+/**
+ * Hash_DRBG: один запрос max_request байт (пакетный Hashgen) и короткие запросы по 32 байта,
+ * где основную долю занимает обновление состояния после запроса.
+ */
+void run_drbg(Suite &suite) {
+    uint8_t entropy[48] = {1};
+    uint8_t nonce[16] = {2};
+    drbg::Hash_drbg generator;
+    generator.instantiate(entropy, sizeof(entropy), nonce, sizeof(nonce));
+    generator.set_reseed_interval(UINT64_MAX);
+    std::vector<uint8_t> out(drbg::Hash_drbg::max_request);
+
+    suite.add("drbg", "generate/32", 32, [&] {
+        generator.generate(out.data(), 32);
+        sink = out[0];
+    });
+    suite.add("drbg", "generate/" + std::to_string(out.size()), out.size(), [&] {
+        generator.generate(out.data(), out.size());
+        sink = out[0];
+    });
+}
+
+};
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // при JSON в стандартный вывод таблица уходит в stderr
+    Suite suite(options, options.json_path == "-" ? std::cerr : std::cout);
+    suite.print_header();
+
+    run_micro(suite);
+
+    std::vector<uint8_t> data(std::max<uint64_t>(1 << 20, std::min<uint64_t>(options.max_size, 1ULL << 30)));
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+    run_chain<256>(suite);
+    run_chain<512>(suite);
+    run_hmac(suite);
+    run_drbg(suite);
+
+    if (options.hash_bits == 256) {
+        run_sweep<256>(suite, options, data);
+    } else {
+        run_sweep<512>(suite, options, data);
+    }
+
+    if (options.json_path == "-") {
+        suite.write_json(std::cout);
+    } else if (!options.json_path.empty()) {
+        std::ofstream out(options.json_path);
+        suite.write_json(out);
+        if (!out) {
+            std::cerr << argv[0] << ": cannot write " << options.json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
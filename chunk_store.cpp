@@ -0,0 +1,553 @@
+#include "chunk_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_hash.h"
+#include "multibuffer.h"
+#include "stats.h"
+#include "streebog.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+namespace chunk_store {
+
+namespace {
+
+struct Index_entry {
+    uint8_t digest[digest_size];
+    uint64_t offset;
+    uint32_t length;
+    uint32_t used;
+};
+
+static_assert(sizeof(Index_entry) == 48, "index format");
+
+const uint64_t initial_capacity = 1 << 16;
+
+uint64_t slot_of(const uint8_t *digest, uint64_t capacity) {
+    uint64_t value;
+    memcpy(&value, digest, sizeof(value));
+    return value & (capacity - 1);
+}
+
+bool entry_used(const void *entry) {
+    return ((const Index_entry *)entry)->used != 0;
+}
+
+uint64_t entry_slot(const void *entry, uint64_t capacity) {
+    return slot_of(((const Index_entry *)entry)->digest, capacity);
+}
+
+const mapped_table::Format index_format = {"chunk index", {'S', 'B', 'C', 'I', 'D', 'X', '\n', 0}, 1,
+                                           sizeof(Index_entry), entry_used, entry_slot};
+
+bool write_all(int fd, const uint8_t *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        auto written = pwrite(fd, data, length, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return true;
+}
+
+bool read_all(int fd, uint8_t *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        auto count = pread(fd, data, length, (off_t)offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        length -= (size_t)count;
+        offset += (uint64_t)count;
+    }
+    return true;
+}
+
+};
+
+Chunk_index::Chunk_index() : table_(index_format) {
+}
+
+uint64_t Chunk_index::count() const {
+    return table_.header()->count;
+}
+
+uint64_t Chunk_index::pack_size() const {
+    return table_.header()->extra;
+}
+
+bool Chunk_index::open(const std::string &path, uint64_t pack_size, std::string &error) {
+    if (!table_.open(path, digest_size, pack_size, initial_capacity, false, error)) {
+        return false;
+    }
+    auto header = table_.header();
+    if (header->tag != digest_size) {
+        error = path + ": not a chunk index or unsupported version";
+        table_.close();
+        return false;
+    }
+
+    // после сбоя часть записей может ссылаться на данные, которые не дошли до chunks.pack
+    if (!header->clean || header->extra != pack_size) {
+        return table_.rebuild(header->capacity, digest_size, pack_size, [pack_size](const void *entry) {
+            auto &chunk = *(const Index_entry *)entry;
+            return chunk.offset + chunk.length <= pack_size;
+        }, error);
+    }
+    return true;
+}
+
+bool Chunk_index::find(const uint8_t *digest, Location &location) const {
+    auto table = table_.entries<Index_entry>();
+    for (auto slot = slot_of(digest, table_.header()->capacity); table[slot].used; slot = table_.next(slot)) {
+        if (memcmp(table[slot].digest, digest, digest_size) == 0) {
+            location = {table[slot].offset, table[slot].length};
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Chunk_index::insert(const uint8_t *digest, const Location &location, std::string &error) {
+    if (!table_.prepare_insert(error)) {
+        return false;
+    }
+    auto table = table_.entries<Index_entry>();
+    auto slot = slot_of(digest, table_.header()->capacity);
+    while (table[slot].used) {
+        slot = table_.next(slot);
+    }
+    auto &entry = table[slot];
+    memcpy(entry.digest, digest, digest_size);
+    entry.offset = location.offset;
+    entry.length = location.length;
+    entry.used = 1;
+    table_.header()->count++;
+    return true;
+}
+
+bool Chunk_index::sync(uint64_t pack_size, std::string &error) {
+    table_.header()->extra = pack_size;
+    return table_.sync(error);
+}
+
+Chunk_store::~Chunk_store() {
+    if (pack_fd_ >= 0) {
+        std::string error;
+        sync(error);
+        close(pack_fd_);
+    }
+}
+
+bool Chunk_store::open(const std::string &directory, std::string &error) {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = directory + ": " + strerror(errno);
+        return false;
+    }
+    auto prefix = directory.back() == '/' ? directory : directory + "/";
+    auto pack_path = prefix + "chunks.pack";
+    pack_fd_ = ::open(pack_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    // блокировка всего хранилища: размер файла данных читается уже под ней
+    int locked = -1;
+    while (pack_fd_ >= 0 && (locked = flock(pack_fd_, LOCK_EX)) != 0 && errno == EINTR) {
+    }
+    struct stat info;
+    if (pack_fd_ < 0 || locked != 0 || fstat(pack_fd_, &info) != 0) {
+        error = pack_path + ": " + strerror(errno);
+        return false;
+    }
+    pack_size_ = (uint64_t)info.st_size;
+    return index_.open(prefix + "index", pack_size_, error);
+}
+
+bool Chunk_store::put(const uint8_t *digest, const uint8_t *data, size_t length, bool &added, std::string &error) {
+    Location location;
+    added = false;
+    if (index_.find(digest, location)) {
+        return true;
+    }
+    if (!write_all(pack_fd_, data, length, pack_size_)) {
+        error = std::string("chunks.pack: ") + strerror(errno);
+        return false;
+    }
+    if (!index_.insert(digest, {pack_size_, (uint32_t)length}, error)) {
+        return false;
+    }
+    pack_size_ += length;
+    added = true;
+    return true;
+}
+
+bool Chunk_store::get(const uint8_t *digest, std::vector<uint8_t> &data, std::string &error) const {
+    Location location;
+    if (!index_.find(digest, location)) {
+        error = "chunk not found";
+        return false;
+    }
+    data.resize(location.length);
+    uint8_t check[digest_size];
+    errno = 0;
+    if (!read_all(pack_fd_, data.data(), data.size(), location.offset)) {
+        error = std::string("chunks.pack: ") + (errno != 0 ? strerror(errno) : "unexpected end of file");
+        return false;
+    }
+    Streebog_256::hash(data.data(), data.size(), check);
+    if (memcmp(check, digest, digest_size) != 0) {
+        error = "chunks.pack: chunk data does not match its digest";
+        return false;
+    }
+    return true;
+}
+
+bool Chunk_store::sync(std::string &error) {
+    if (fdatasync(pack_fd_) != 0) {
+        error = std::string("chunks.pack: ") + strerror(errno);
+        return false;
+    }
+    return index_.sync(pack_size_, error);
+}
+
+namespace {
+
+void collect_files(const std::string &path, std::vector<std::string> &files, std::vector<std::string> &errors) {
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        errors.push_back(path + ": " + strerror(errno));
+        return;
+    }
+    std::vector<std::string> children;
+    while (auto entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            children.emplace_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(children.begin(), children.end());
+
+    auto prefix = path.back() == '/' ? path : path + "/";
+    for (const auto &child : children) {
+        auto child_path = prefix + child;
+        struct stat info;
+        if (lstat(child_path.c_str(), &info) != 0) {
+            errors.push_back(child_path + ": " + strerror(errno));
+        } else if (S_ISDIR(info.st_mode)) {
+            collect_files(child_path, files, errors);
+        } else if (S_ISREG(info.st_mode)) {
+            files.push_back(child_path);
+        }
+        // символические ссылки, устройства и сокеты пропускаются
+    }
+}
+
+/**
+ * Разбирает данные окнами: фрагменты окна хешируются параллельно, затем по порядку сохраняются.
+ */
+class Ingester {
+public:
+    Ingester(Chunk_store &store, const Ingest_options &options, Ingest_report &report, std::ostream *recipe)
+            : store_(store), options_(options), report_(report), recipe_(recipe), chunker_(options.chunking),
+              pool_(options.threads) {
+    }
+
+    bool add_path(const std::string &path, std::string &error) {
+        if (path == "-") {
+            return add_stream(STDIN_FILENO, path, 0, error);
+        }
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = strerror(errno);
+            return false;
+        }
+        struct stat info;
+        bool result;
+        file_hash::Mapped_file file;
+        if (fstat(fd, &info) != 0) {
+            error = strerror(errno);
+            result = false;
+        } else if (S_ISREG(info.st_mode) && (size_t)info.st_size >= file_hash::mmap_threshold &&
+                   file.map(fd, (size_t)info.st_size)) {
+            begin_file(path, file.size());
+            result = add_mapped(file.data(), file.size(), error);
+        } else {
+            result = add_stream(fd, path, S_ISREG(info.st_mode) ? (uint64_t)info.st_size : 0, error);
+        }
+        close(fd);
+        return result;
+    }
+
+private:
+    void begin_file(const std::string &path, uint64_t size) {
+        report_.files++;
+        if (recipe_ != nullptr) {
+            *recipe_ << "file " << size << " " << path << "\n";
+        }
+    }
+
+    bool add_mapped(const uint8_t *data, size_t size, std::string &error) {
+        size_t position = 0;
+        while (position < size) {
+            auto length = std::min(size - position, options_.window_size);
+            size_t consumed;
+            if (!process(data + position, length, position, position + length == size, consumed, error)) {
+                return false;
+            }
+            position += consumed;
+        }
+        return true;
+    }
+
+    bool add_stream(int fd, const std::string &path, uint64_t size, std::string &error) {
+        buffer_.resize(options_.window_size);
+        begin_file(path, size);
+        size_t filled = 0;
+        uint64_t base = 0;
+        bool at_end = false;
+        while (!at_end) {
+            while (filled < buffer_.size()) {
+                ssize_t count;
+                {
+                    STRIBOG_STATS_TIME(io);
+                    count = read(fd, buffer_.data() + filled, buffer_.size() - filled);
+                }
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count < 0) {
+                    error = strerror(errno);
+                    return false;
+                }
+                if (count == 0) {
+                    at_end = true;
+                    break;
+                }
+                filled += (size_t)count;
+            }
+            size_t consumed;
+            if (!process(buffer_.data(), filled, base, at_end, consumed, error)) {
+                return false;
+            }
+            memmove(buffer_.data(), buffer_.data() + consumed, filled - consumed);
+            filled -= consumed;
+            base += consumed;
+        }
+        return true;
+    }
+
+    bool process(const uint8_t *data, size_t length, uint64_t base, bool at_end, size_t &consumed,
+                 std::string &error) {
+        chunks_.clear();
+        consumed = chunker_.split(data, length, base, at_end, chunks_);
+
+        auto count = chunks_.size();
+        messages_.resize(count);
+        lengths_.resize(count);
+        digests_.resize(count * digest_size);
+        for (size_t i = 0; i < count; i++) {
+            messages_[i] = data + (chunks_[i].offset - base);
+            lengths_[i] = chunks_[i].length;
+        }
+
+        // несколько частей на поток, чтобы неравные по размеру фрагменты не оставляли потоки без дела
+        auto parts = std::min(count, pool_.size() == 1 ? 1 : pool_.size() * 4);
+        for (size_t part = 0; part < parts; part++) {
+            auto begin = count * part / parts;
+            auto end = count * (part + 1) / parts;
+            auto task = [this, begin, end] {
+                multibuffer::hash_many(messages_.data() + begin, lengths_.data() + begin, end - begin,
+                                       digests_.data() + begin * digest_size, 256);
+            };
+            if (parts == 1) {
+                task();
+            } else {
+                pool_.submit(task);
+            }
+        }
+        pool_.wait();
+
+        for (size_t i = 0; i < count; i++) {
+            auto digest = digests_.data() + i * digest_size;
+            bool added;
+            if (!store_.put(digest, messages_[i], lengths_[i], added, error)) {
+                return false;
+            }
+            report_.chunks++;
+            report_.bytes += lengths_[i];
+            if (added) {
+                report_.new_chunks++;
+                report_.new_bytes += lengths_[i];
+            }
+            if (recipe_ != nullptr) {
+                *recipe_ << utils::bytes_to_hex(digest, digest_size) << " " << lengths_[i] << "\n";
+            }
+        }
+        return true;
+    }
+
+    Chunk_store &store_;
+    const Ingest_options &options_;
+    Ingest_report &report_;
+    std::ostream *recipe_;
+    chunker::Chunker chunker_;
+    Thread_pool pool_;
+    std::vector<uint8_t> buffer_;
+    std::vector<chunker::Chunk> chunks_;
+    std::vector<const uint8_t *> messages_;
+    std::vector<size_t> lengths_;
+    std::vector<uint8_t> digests_;
+};
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " --ingest STORE [-j THREADS] [--avg-chunk N] [--recipe OUT] [PATH]..."
+              << std::endl
+              << std::endl
+              << "Split files into content-defined chunks (FastCDC-like), hash the chunks with Streebog-256" << std::endl
+              << "in parallel and append the chunks not yet in STORE. Directories are walked recursively;" << std::endl
+              << "with no PATH, or when PATH is -, read standard input. Prints the dedup ratio and throughput." << std::endl
+              << std::endl
+              << "  -j THREADS     hashing threads (default: number of CPUs)" << std::endl
+              << "  --avg-chunk N  average chunk size, a power of two (default 8192; min N/4, max N*8)" << std::endl
+              << "  --recipe OUT   write \"file <size> <path>\" and \"<digest> <length>\" lines for each chunk" << std::endl;
+}
+
+};
+
+bool ingest(Chunk_store &store, const std::vector<std::string> &paths, const Ingest_options &options,
+            Ingest_report &report, std::vector<std::string> &errors) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::ofstream recipe;
+    if (!options.recipe_path.empty()) {
+        recipe.open(options.recipe_path);
+        if (!recipe) {
+            errors.push_back(options.recipe_path + ": " + strerror(errno));
+            return false;
+        }
+    }
+
+    // окно должно вмещать несколько фрагментов максимального размера, иначе разбор не продвинется
+    auto window_options = options;
+    window_options.window_size = std::max(options.window_size, 4 * options.chunking.max_size);
+    Ingester ingester(store, window_options, report, recipe.is_open() ? &recipe : nullptr);
+
+    bool stored = true;
+    for (const auto &path : paths) {
+        std::vector<std::string> files;
+        struct stat info;
+        if (path != "-" && stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            collect_files(path, files, errors);
+        } else {
+            files.push_back(path);
+        }
+        for (const auto &file : files) {
+            std::string error;
+            if (!ingester.add_path(file, error)) {
+                errors.push_back(file + ": " + error);
+            }
+        }
+    }
+
+    std::string error;
+    if (!store.sync(error)) {
+        errors.push_back(error);
+        stored = false;
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stored;
+}
+
+int run(int argc, char **argv) {
+    std::string store_path;
+    Ingest_options options;
+    std::vector<std::string> paths;
+    if (argc < 3 || argv[2][0] == '-') {
+        print_usage(argv[0]);
+        return argc < 3 ? 2 : 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-" || arg[0] != '-') {
+            paths.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << argv[0] << ": unknown option or missing value " << arg << std::endl;
+            print_usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        auto number = strtoul(value.c_str(), nullptr, 10);
+        if (arg == "--ingest") {
+            store_path = value;
+        } else if (arg == "-j" && number > 0) {
+            options.threads = number;
+        } else if (arg == "--avg-chunk") {
+            options.chunking = {number / 4, number, number * 8};
+        } else if (arg == "--recipe") {
+            options.recipe_path = value;
+        } else {
+            std::cerr << argv[0] << ": bad option " << arg << " " << value << std::endl;
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (store_path.empty() || !chunker::valid(options.chunking)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (paths.empty()) {
+        paths.emplace_back("-");
+    }
+
+    Chunk_store store;
+    std::string error;
+    if (!store.open(store_path, error)) {
+        std::cerr << argv[0] << ": " << error << std::endl;
+        return 1;
+    }
+
+    Ingest_report report;
+    std::vector<std::string> errors;
+    bool stored = ingest(store, paths, options, report, errors);
+    for (const auto &message : errors) {
+        std::cerr << argv[0] << ": " << message << std::endl;
+    }
+
+    const double mib = 1 << 20;
+    auto seconds = std::max(report.seconds, 1e-9);
+    std::cout << "ingested: " << report.files << " files, " << report.bytes << " bytes in " << report.chunks
+              << " chunks (avg " << (report.chunks == 0 ? 0 : report.bytes / report.chunks) << " bytes)" << std::endl
+              << "new: " << report.new_chunks << " chunks, " << report.new_bytes << " bytes stored, dedup ratio ";
+    if (report.new_bytes == 0) {
+        std::cout << "all chunks already stored" << std::endl;
+    } else {
+        std::cout << report.dedup_ratio() << ":1" << std::endl;
+    }
+    std::cout << "store: " << store.chunks() << " chunks, " << store.stored_bytes() << " bytes" << std::endl
+              << "throughput: " << report.bytes / seconds / mib << " MiB/s (" << report.seconds << " s)" << std::endl;
+    return stored && errors.empty() ? 0 : 1;
+}
+
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chunker.h"
+#include "mapped_table.h"
+
+/**
+ * Хранилище фрагментов с дедупликацией по дайджестам Streebog-256.
+ *
+ * Каталог хранилища содержит два файла: chunks.pack -- данные уникальных фрагментов подряд,
+ * index -- отображённая в память хеш-таблица с открытой адресацией "дайджест -> (смещение, длина)".
+ * Повторная загрузка почти не изменившихся данных только находит фрагменты в индексе,
+ * в chunks.pack дописываются лишь новые.
+ */
+namespace chunk_store {
+
+const size_t digest_size = 32;
+
+struct Location {
+    uint64_t offset;
+    uint32_t length;
+};
+
+/**
+ * Индекс в файле mapped_table: записи по 48 байт, в поле extra заголовка -- размер файла данных.
+ */
+class Chunk_index {
+public:
+    Chunk_index();
+    Chunk_index(const Chunk_index &) = delete;
+    Chunk_index &operator=(const Chunk_index &) = delete;
+
+    /**
+     * Открывает или создаёт индекс. pack_size -- фактический размер файла данных: после
+     * аварийного завершения записи, указывающие за его пределы, отбрасываются.
+     */
+    bool open(const std::string &path, uint64_t pack_size, std::string &error);
+
+    bool find(const uint8_t *digest, Location &location) const;
+
+    /**
+     * Добавляет запись; дайджест не должен быть в индексе.
+     */
+    bool insert(const uint8_t *digest, const Location &location, std::string &error);
+
+    /**
+     * Сбрасывает таблицу на диск и помечает индекс согласованным с файлом данных размера pack_size.
+     */
+    bool sync(uint64_t pack_size, std::string &error);
+
+    uint64_t count() const;
+
+    /**
+     * Размер файла данных на момент последнего sync.
+     */
+    uint64_t pack_size() const;
+
+private:
+    mapped_table::Table table_;
+};
+
+class Chunk_store {
+public:
+    Chunk_store() = default;
+    Chunk_store(const Chunk_store &) = delete;
+    Chunk_store &operator=(const Chunk_store &) = delete;
+
+    ~Chunk_store();
+
+    /**
+     * Открывает каталог хранилища, создавая его при необходимости. Хранилище открывается одним
+     * процессом: второй ждёт (flock на chunks.pack), пока первый его не закроет.
+     */
+    bool open(const std::string &directory, std::string &error);
+
+    /**
+     * Сохраняет фрагмент, если его дайджеста ещё нет; added сообщает, был ли он записан.
+     */
+    bool put(const uint8_t *digest, const uint8_t *data, size_t length, bool &added, std::string &error);
+
+    /**
+     * Читает фрагмент по дайджесту; false, если его нет или файл данных повреждён.
+     */
+    bool get(const uint8_t *digest, std::vector<uint8_t> &data, std::string &error) const;
+
+    /**
+     * fdatasync данных, затем индекса. Вызывается в конце загрузки и при закрытии.
+     */
+    bool sync(std::string &error);
+
+    uint64_t chunks() const {
+        return index_.count();
+    }
+
+    uint64_t stored_bytes() const {
+        return pack_size_;
+    }
+
+private:
+    Chunk_index index_;
+    int pack_fd_ = -1;
+    uint64_t pack_size_ = 0;
+};
+
+struct Ingest_options {
+    chunker::Options chunking;
+    size_t threads = 0;                 // потоки хеширования, 0 -- по числу процессоров
+    size_t window_size = 64 << 20;      // байт, разбираемых и хешируемых за один проход
+    std::string recipe_path;            // список фрагментов каждого файла для восстановления
+};
+
+struct Ingest_report {
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t chunks = 0;
+    uint64_t new_chunks = 0;
+    uint64_t new_bytes = 0;
+    double seconds = 0;
+
+    /**
+     * Отношение прочитанных байт к записанным в хранилище (0 -- ничего не записано).
+     */
+    double dedup_ratio() const {
+        return new_bytes == 0 ? 0 : (double)bytes / (double)new_bytes;
+    }
+};
+
+/**
+ * Разбивает файлы (каталоги обходятся рекурсивно, "-" -- стандартный ввод), хеширует фрагменты
+ * в пуле потоков многобуферным движком и сохраняет новые. При ошибке чтения файла загрузка
+ * продолжается, описание попадает в errors.
+ */
+bool ingest(Chunk_store &store, const std::vector<std::string> &paths, const Ingest_options &options,
+            Ingest_report &report, std::vector<std::string> &errors);
+
+/**
+ * Разбор командной строки для --ingest STORE.
+ */
+int run(int argc, char **argv);
+
+};
@@ -0,0 +1,76 @@
+#include "chunker.h"
+
+#include <algorithm>
+
+namespace chunker {
+
+namespace {
+
+/**
+ * bits единиц в старших разрядах: младшие разряды fp зависят лишь от последних байт,
+ * старшие -- от окна в 64 байта.
+ */
+uint64_t top_mask(size_t bits) {
+    return bits == 0 ? 0 : ~0ULL << (64 - bits);
+}
+
+size_t log2(size_t value) {
+    size_t bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+};
+
+bool valid(const Options &options) {
+    auto average = options.average_size;
+    return average >= 256 && (average & (average - 1)) == 0 && options.min_size <= average &&
+           average <= options.max_size && options.max_size <= UINT32_MAX;
+}
+
+Chunker::Chunker(const Options &options) : options_(options) {
+    // уровень нормализации 2: до среднего размера маска на 2 бита строже, после -- на 2 бита мягче
+    auto bits = log2(options.average_size);
+    mask_small_ = top_mask(bits + 2);
+    mask_large_ = top_mask(bits > 2 ? bits - 2 : 0);
+}
+
+size_t Chunker::next(const uint8_t *data, size_t length) const {
+    auto end = std::min(length, options_.max_size);
+    if (end <= options_.min_size) {
+        return end;
+    }
+    auto normal = std::min(end, options_.average_size);
+
+    uint64_t fingerprint = 0;
+    size_t i = options_.min_size;
+    for (; i < normal; i++) {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if ((fingerprint & mask_small_) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < end; i++) {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if ((fingerprint & mask_large_) == 0) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+size_t Chunker::split(const uint8_t *data, size_t length, uint64_t base, bool at_end,
+                      std::vector<Chunk> &chunks) const {
+    size_t position = 0;
+    while (position < length && (at_end || length - position >= options_.max_size)) {
+        auto size = next(data + position, length - position);
+        chunks.push_back({base + position, (uint32_t)size});
+        position += size;
+    }
+    return position;
+}
+
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Разбиение потока на фрагменты по содержимому (content-defined chunking, как FastCDC).
+ *
+ * Граница ставится там, где скользящий gear-хеш fp = (fp << 1) + gear[byte] обнуляется под маской,
+ * поэтому вставка или удаление байт сдвигает только соседние границы, а остальные фрагменты
+ * остаются прежними и находятся в индексе. До average_size действует более строгая маска,
+ * после -- более мягкая (нормализация FastCDC), так что размеры собираются около среднего.
+ */
+namespace chunker {
+
+namespace detail {
+
+constexpr uint64_t splitmix64(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+constexpr std::array<uint64_t, 256> make_gear() {
+    std::array<uint64_t, 256> gear = {};
+    uint64_t state = 0x5354524942424f47ULL;    // "STRIBBOG"
+    for (auto &value : gear) {
+        value = splitmix64(state);
+    }
+    return gear;
+}
+
+};
+
+/**
+ * Таблица gear фиксирована: от неё зависят границы, а значит и совпадение фрагментов между запусками.
+ */
+inline constexpr std::array<uint64_t, 256> gear = detail::make_gear();
+
+struct Options {
+    size_t min_size = 2 * 1024;
+    size_t average_size = 8 * 1024;    // степень двойки
+    size_t max_size = 64 * 1024;
+};
+
+/**
+ * true, если average_size -- степень двойки от 256 байт и min_size <= average_size <= max_size.
+ */
+bool valid(const Options &options);
+
+struct Chunk {
+    uint64_t offset;
+    uint32_t length;
+};
+
+class Chunker {
+public:
+    explicit Chunker(const Options &options = Options());
+
+    /**
+     * Длина первого фрагмента data. Результат окончателен, если length >= max_size или
+     * data заканчивается вместе с потоком; иначе граница может оказаться дальше.
+     */
+    size_t next(const uint8_t *data, size_t length) const;
+
+    /**
+     * Добавляет в chunks фрагменты data со смещениями от base и возвращает число разобранных байт.
+     * Без at_end хвост короче max_size не разбирается: его нужно передать снова вместе со
+     * следующими данными.
+     */
+    size_t split(const uint8_t *data, size_t length, uint64_t base, bool at_end, std::vector<Chunk> &chunks) const;
+
+    const Options &options() const {
+        return options_;
+    }
+
+private:
+    Options options_;
+    uint64_t mask_small_;
+    uint64_t mask_large_;
+};
+
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+#include "constants.h"
+#include "stats.h"
+
+/**
+ * Табличная реализация функции сжатия g_N.
+ *
+ * Состояние хранится как восемь 64-битных слов (limb 0 -- младшие 64 бита 512-битного числа),
+ * а преобразования S, P и L объединены в восемь таблиц по 256 значений:
+ *
+ *     lps_table[j][b] = L(pi[b] << 8j),
+ *     LPS(x)[i] = xor_j lps_table[j][byte_i(x[j])].
+ *
+ * Таким образом одно LPS стоит 64 загрузки и 56 XOR вместо побитового умножения на матрицу.
+ */
+namespace compression {
+
+using state_t = std::array<uint64_t, 8>;
+using lps_table_t = std::array<std::array<uint64_t, 256>, 8>;
+
+constexpr state_t from_uint512(const std::array<__uint128_t, 4> &value) {
+    state_t result = {};
+    for (int i = 0; i < 8; i++) {
+        result[i] = (uint64_t)(value[3 - i / 2] >> (64 * (i % 2)));
+    }
+    return result;
+}
+
+constexpr std::array<__uint128_t, 4> to_uint512(const state_t &state) {
+    std::array<__uint128_t, 4> result = {};
+    for (int i = 0; i < 4; i++) {
+        result[3 - i] = ((__uint128_t)state[2 * i + 1] << 64) | state[2 * i];
+    }
+    return result;
+}
+
+constexpr lps_table_t make_lps_table() {
+    const auto &matrix = constants::linear_transformation::linear_matrix;
+    const auto &pi = constants::pi_transformation::pi;
+
+    lps_table_t result = {};
+    for (int j = 0; j < 8; j++) {
+        for (int b = 0; b < 256; b++) {
+            auto value = (uint64_t)pi[b] << (8 * j);
+            uint64_t transformed = 0;
+            for (int i = 0; i < 64; i++) {
+                if ((value >> i) & 1) {
+                    transformed ^= matrix[i];
+                }
+            }
+            result[j][b] = transformed;
+        }
+    }
+    return result;
+}
+
+constexpr std::array<state_t, 12> make_iteration_constants() {
+    const auto &values = constants::iteration_constants::iteration_constants;
+
+    std::array<state_t, 12> result = {};
+    for (int i = 0; i < 12; i++) {
+        result[i] = from_uint512(values[i]);
+    }
+    return result;
+}
+
+alignas(64) inline constexpr lps_table_t lps_table = make_lps_table();
+alignas(64) inline constexpr std::array<state_t, 12> iteration_constants = make_iteration_constants();
+
+inline const lps_table_t &get_lps_table() {
+    return lps_table;
+}
+
+inline const std::array<state_t, 12> &get_iteration_constants() {
+    return iteration_constants;
+}
+
+constexpr state_t lps(const state_t &state) {
+    const auto &table = lps_table;
+
+    state_t result = {};
+    for (int i = 0; i < 8; i++) {
+        const int shift = 8 * i;
+        result[i] = table[0][(uint8_t)(state[0] >> shift)] ^
+                    table[1][(uint8_t)(state[1] >> shift)] ^
+                    table[2][(uint8_t)(state[2] >> shift)] ^
+                    table[3][(uint8_t)(state[3] >> shift)] ^
+                    table[4][(uint8_t)(state[4] >> shift)] ^
+                    table[5][(uint8_t)(state[5] >> shift)] ^
+                    table[6][(uint8_t)(state[6] >> shift)] ^
+                    table[7][(uint8_t)(state[7] >> shift)];
+    }
+    return result;
+}
+
+constexpr state_t xor_state(const state_t &a, const state_t &b) {
+    state_t result = {};
+    for (int i = 0; i < 8; i++) {
+        result[i] = a[i] ^ b[i];
+    }
+    return result;
+}
+
+/**
+ * Сложение по модулю 2^512 (для N и Sigma).
+ */
+inline void add(state_t &value, const state_t &term) {
+    unsigned carry = 0;
+    for (int i = 0; i < 8; i++) {
+        auto sum = (__uint128_t)value[i] + term[i] + carry;
+        value[i] = (uint64_t)sum;
+        carry = (unsigned)(sum >> 64);
+    }
+}
+
+inline void add(state_t &value, uint64_t term) {
+    for (int i = 0; i < 8 && term != 0; i++) {
+        value[i] += term;
+        term = value[i] < term ? 1 : 0;
+    }
+}
+
+inline state_t e_function(const state_t &k, const state_t &m) {
+    const auto &c_values = iteration_constants;
+
+#ifdef STRIBOG_STATS
+    // со статистикой ключевое расписание считается отдельно, чтобы замерить его и раунды двумя
+    // интервалами, а не двадцатью четырьмя; результат тот же
+    state_t keys[12];
+    {
+        STRIBOG_STATS_TIME(key_schedule);
+        auto key = k;
+        for (int i = 0; i < 12; i++) {
+            key = lps(xor_state(key, c_values[i]));
+            keys[i] = key;
+        }
+    }
+    STRIBOG_STATS_TIME(rounds);
+    auto value = xor_state(k, m);
+    for (int i = 0; i < 12; i++) {
+        value = xor_state(lps(value), keys[i]);
+    }
+#else
+    auto key = k;
+    auto value = xor_state(key, m);
+    for (int i = 0; i < 12; i++) {
+        value = lps(value);
+        key = lps(xor_state(key, c_values[i]));
+        value = xor_state(value, key);
+    }
+#endif
+    return value;
+}
+
+inline state_t g_function(const state_t &h, const state_t &m, const state_t &N) {
+    auto key = lps(xor_state(h, N));
+    auto result = e_function(key, m);
+    for (int i = 0; i < 8; i++) {
+        result[i] ^= h[i] ^ m[i];
+    }
+    return result;
+}
+
+/**
+ * g_N для двух цепочек с общими m и N (Streebog-256 и -512 над одним сообщением): четыре
+ * независимых LPS за раунд вместо двух, так что обращения к таблице одной цепочки перекрываются
+ * вычислениями другой. Результат -- как у двух вызовов g_function.
+ */
+inline void g_pair(state_t &first, state_t &second, const state_t &m, const state_t &N) {
+    const auto &c_values = iteration_constants;
+
+    auto key_first = lps(xor_state(first, N));
+    auto key_second = lps(xor_state(second, N));
+    auto value_first = xor_state(key_first, m);
+    auto value_second = xor_state(key_second, m);
+#ifdef STRIBOG_STATS
+    state_t keys_first[12], keys_second[12];
+    {
+        STRIBOG_STATS_TIME(key_schedule);
+        for (int i = 0; i < 12; i++) {
+            key_first = lps(xor_state(key_first, c_values[i]));
+            key_second = lps(xor_state(key_second, c_values[i]));
+            keys_first[i] = key_first;
+            keys_second[i] = key_second;
+        }
+    }
+    {
+        STRIBOG_STATS_TIME(rounds);
+        for (int i = 0; i < 12; i++) {
+            value_first = xor_state(lps(value_first), keys_first[i]);
+            value_second = xor_state(lps(value_second), keys_second[i]);
+        }
+    }
+#else
+    for (int i = 0; i < 12; i++) {
+        value_first = lps(value_first);
+        value_second = lps(value_second);
+        key_first = lps(xor_state(key_first, c_values[i]));
+        key_second = lps(xor_state(key_second, c_values[i]));
+        value_first = xor_state(value_first, key_first);
+        value_second = xor_state(value_second, key_second);
+    }
+#endif
+    for (int i = 0; i < 8; i++) {
+        first[i] ^= value_first[i] ^ m[i];
+        second[i] ^= value_second[i] ^ m[i];
+    }
+}
+
+};
@@ -1,9 +1,6 @@
 #pragma once
 
 #include <stdint.h>
-#include <vector>
-#include <string>
-#include <algorithm>
 #include <array>
 
 #include "utils.h"
@@ -11,7 +8,7 @@
 namespace constants {
 
 namespace pi_transformation {
-static int pi[] = {
+inline constexpr uint8_t pi[] = {
         252, 238, 221, 17, 207, 110, 49, 22, 251, 196, 250, 218, 35, 197, 4, 77, 233, 119, 240, 219, 147, 46,
         153, 186, 23, 54, 241, 187, 20, 205, 95, 193, 249, 24, 101, 90, 226, 92, 239, 33, 129, 28, 60, 66,
         139, 1, 142, 79, 5, 132, 2, 174, 227, 106, 143, 160, 6, 11, 237, 152, 127, 212, 211, 31, 235, 52, 44,
@@ -27,14 +24,14 @@ static int pi[] = {
 };
 
 namespace tau_transformation {
-static int tau[] = {
+inline constexpr uint8_t tau[] = {
         0, 8, 16, 24, 32, 40, 48, 56, 1, 9, 17, 25, 33, 41, 49, 57, 2, 10, 18, 26, 34, 42, 50, 58, 3, 11, 19,
         27, 35, 43, 51, 59, 4, 12, 20, 28, 36, 44, 52, 60, 5, 13, 21, 29, 37, 45, 53, 61, 6, 14, 22, 30, 38,
         46, 54, 62, 7, 15, 23, 31, 39, 47, 55, 63};
 };
 
 namespace linear_transformation {
-static const char* string_matrix[] = {
+constexpr const char* string_matrix[] = {
         "8e20faa72ba0b470", "47107ddd9b505a38", "ad08b0e0c3282d1c", "d8045870ef14980e",
         "6c022c38f90a4c07", "3601161cf205268d", "1b8e0b0e798c13c8", "83478b07b2468764",
         "a011d380818e8f40", "5086e740ce47c920", "2843fd2067adea10", "14aff010bdd87508",
@@ -52,27 +49,25 @@ static const char* string_matrix[] = {
         "70a6a56e2440598e", "3853dc371220a247", "1ca76e95091051ad", "0edd37c48a08a6d8",
         "07e095624504536c", "8d70c431ac02a736", "c83862965601dd1b", "641c314b2b8ee083"};
 
-inline const std::array<uint64_t, 64> get_linear_matrix() {
-    static std::array<uint64_t, 64> matrix;
-    static bool initialized = false;
-    if (!initialized) {
-        for (int i = 0; i < 64; i++) {
-            matrix[63 - i] = utils::parse_hex<uint64_t>(string_matrix[i]);
-        }
-//        for(const auto& value : string_matrix) {
-//            matrix.push_back(utils::parse_hex<uint64_t>(value));
-//        }
-//        std::reverse(matrix.begin(), matrix.end());
+constexpr std::array<uint64_t, 64> make_linear_matrix() {
+    std::array<uint64_t, 64> matrix = {};
+    for (int i = 0; i < 64; i++) {
+        matrix[63 - i] = utils::parse_hex<uint64_t>(string_matrix[i], 16);
     }
-
     return matrix;
 }
 
+inline constexpr std::array<uint64_t, 64> linear_matrix = make_linear_matrix();
+
+inline const std::array<uint64_t, 64> &get_linear_matrix() {
+    return linear_matrix;
+}
+
 };
 
 namespace iteration_constants {
 
-static const char* c_values[] = {
+constexpr const char* c_values[] = {
         "b1085bda1ecadae9ebcb2f81c0657c1f2f6a76432e45d016714eb88d7585c4fc4b7ce09192676901a2422a08a460d31505767436cc744d23dd806559f2a64507",
         "6fa3b58aa99d2f1a4fe39d460f70b5d7f3feea720a232b9861d55e0f16b501319ab5176b12d699585cb561c2db0aa7ca55dda21bd7cbcd56e679047021b19bb7",
         "f574dcac2bce2fc70a39fc286a3d843506f15e5f529c1f8bf2ea7514b1297b7bd3e20fe490359eb1c1c93a376062db09c2b6f443867adb31991e96f50aba0ab2",
@@ -87,19 +82,21 @@ static const char* c_values[] = {
         "378ee767f11631bad21380b00449b17acda43c32bcdf1d77f82012d430219f9b5d80ef9d1891cc86e71da4aa88e12852faf417d5d9b21b9948bc924af11bd720"
     };
 
-inline const std::vector<std::array<__uint128_t, 4> > get_iteration_constants() {
-    static std::vector<std::array<__uint128_t, 4> > matrix;
-    if (matrix.empty()) {
-        for(const auto& value : c_values) {
-            matrix.emplace_back();
-            for (int i = 0; i < 4; i++) {
-                matrix.back()[i] = utils::parse_hex<__uint128_t>(value + 32 * i);
-            }
+constexpr std::array<std::array<__uint128_t, 4>, 12> make_iteration_constants() {
+    std::array<std::array<__uint128_t, 4>, 12> matrix = {};
+    for (int j = 0; j < 12; j++) {
+        for (int i = 0; i < 4; i++) {
+            matrix[j][i] = utils::parse_hex<__uint128_t>(c_values[j] + 32 * i, 32);
         }
     }
-
     return matrix;
 }
 
+inline constexpr std::array<std::array<__uint128_t, 4>, 12> iteration_constants = make_iteration_constants();
+
+inline const std::array<std::array<__uint128_t, 4>, 12> &get_iteration_constants() {
+    return iteration_constants;
+}
+
 };
 };
\ No newline at end of file
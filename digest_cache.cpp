@@ -0,0 +1,221 @@
+#include "digest_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+
+namespace digest_cache {
+
+namespace {
+
+struct Cache_entry {
+    Key key;
+    uint32_t hash_bits;
+    uint32_t last_seen;     // поколение последнего поиска или записи; 0 -- пустая ячейка
+    uint8_t digest[max_digest_size];
+    uint64_t reserved[2];
+};
+
+static_assert(sizeof(Cache_entry) == 128, "cache format");
+
+const uint64_t initial_capacity = 1 << 14;
+const uint64_t racy_window_ns = 1000000000;
+
+uint64_t mix(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t slot_of(uint64_t device, uint64_t inode, uint32_t hash_bits, uint64_t capacity) {
+    return mix(mix(device ^ (uint64_t)hash_bits << 48) ^ inode) & (capacity - 1);
+}
+
+bool entry_used(const void *entry) {
+    return ((const Cache_entry *)entry)->last_seen != 0;
+}
+
+uint64_t entry_slot(const void *entry, uint64_t capacity) {
+    auto &cached = *(const Cache_entry *)entry;
+    return slot_of(cached.key.device, cached.key.inode, cached.hash_bits, capacity);
+}
+
+const mapped_table::Format cache_format = {"digest cache", {'S', 'B', 'D', 'C', 'A', 'C', '\n', 0}, 1,
+                                           sizeof(Cache_entry), entry_used, entry_slot};
+
+bool same_file(const Key &a, const Key &b) {
+    return a.device == b.device && a.inode == b.inode;
+}
+
+bool same_version(const Key &a, const Key &b) {
+    return a.size == b.size && a.mtime_ns == b.mtime_ns && a.ctime_ns == b.ctime_ns;
+}
+
+uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+};
+
+Key key_of(const struct stat &info) {
+    return {(uint64_t)info.st_dev, (uint64_t)info.st_ino, (uint64_t)info.st_size,
+            (uint64_t)info.st_mtim.tv_sec * 1000000000 + (uint64_t)info.st_mtim.tv_nsec,
+            (uint64_t)info.st_ctim.tv_sec * 1000000000 + (uint64_t)info.st_ctim.tv_nsec};
+}
+
+Cache::Cache() : table_(cache_format) {
+}
+
+Cache::~Cache() {
+    std::string error;
+    close(error);
+}
+
+bool Cache::open(const std::string &path, const Policy &policy, std::string &error) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    table_.close();
+    policy_ = policy;
+    error_.clear();
+
+    if (!table_.open(path, 0, 0, initial_capacity, true, error)) {
+        return false;
+    }
+    // после сбоя запись могла остаться наполовину записанной -- такой кэш не используется
+    auto header = table_.header();
+    if (!header->clean && !table_.rebuild(header->capacity, header->tag, 0, mapped_table::Keep(), error)) {
+        table_.close();
+        return false;
+    }
+    header = table_.header();
+    generation_ = header->tag + 1 == 0 ? 1 : header->tag + 1;
+    header->tag = generation_;
+    return true;
+}
+
+Lookup_result Cache::lookup(const Key &key, size_t hash_bits, uint8_t *digest) {
+    Cache_entry *found = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (!table_.is_open()) {
+            misses_++;
+            return miss;
+        }
+        auto table = table_.entries<Cache_entry>();
+        for (auto slot = slot_of(key.device, key.inode, (uint32_t)hash_bits, table_.header()->capacity);
+             __atomic_load_n(&table[slot].last_seen, __ATOMIC_RELAXED) != 0; slot = table_.next(slot)) {
+            auto &entry = table[slot];
+            if (same_file(entry.key, key) && entry.hash_bits == hash_bits) {
+                if (same_version(entry.key, key)) {
+                    found = &entry;
+                    memcpy(digest, entry.digest, hash_bits / 8);
+                    // поиски идут параллельно и пишут одно и то же значение
+                    __atomic_store_n(&entry.last_seen, generation_, __ATOMIC_RELAXED);
+                }
+                break;
+            }
+        }
+    }
+    if (found == nullptr) {
+        misses_++;
+        return miss;
+    }
+
+    // выборка зависит от файла и поколения: каждую ночь проверяется другая часть дерева
+    auto sample = (double)(mix(mix(key.device ^ generation_) ^ key.inode) >> 11) * 0x1.0p-53;
+    if (!policy_.trust || sample < policy_.verify_fraction) {
+        verified_++;
+        return verify;
+    }
+    hits_++;
+    return hit;
+}
+
+bool Cache::record(const Key &key, size_t hash_bits, const uint8_t *digest, const uint8_t *expected) {
+    auto digest_size = hash_bits / 8;
+    if (expected != nullptr) {
+        if (memcmp(digest, expected, digest_size) != 0) {
+            mismatches_++;
+            return false;
+        }
+        return true;
+    }
+    if (digest_size > max_digest_size || std::max(key.mtime_ns, key.ctime_ns) + racy_window_ns > now_ns()) {
+        return true;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!table_.is_open() || !error_.empty() || !table_.prepare_insert(error_)) {
+        return true;
+    }
+
+    auto table = table_.entries<Cache_entry>();
+    auto slot = slot_of(key.device, key.inode, (uint32_t)hash_bits, table_.header()->capacity);
+    while (table[slot].last_seen != 0 && !(same_file(table[slot].key, key) && table[slot].hash_bits == hash_bits)) {
+        slot = table_.next(slot);
+    }
+    auto &entry = table[slot];
+    if (entry.last_seen == 0) {
+        table_.header()->count++;
+    }
+    entry.key = key;
+    entry.hash_bits = (uint32_t)hash_bits;
+    memcpy(entry.digest, digest, digest_size);
+    entry.last_seen = generation_;
+    stored_++;
+    return true;
+}
+
+bool Cache::compact(std::string &error) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!table_.is_open()) {
+        return true;
+    }
+    auto capacity = table_.header()->capacity;
+    auto table = table_.entries<Cache_entry>();
+    uint64_t current = 0;
+    for (uint64_t i = 0; i < capacity; i++) {
+        current += table[i].last_seen == generation_ ? 1 : 0;
+    }
+    uint64_t new_capacity = initial_capacity;
+    while (current * 2 > new_capacity) {
+        new_capacity *= 2;
+    }
+    auto generation = generation_;
+    return table_.rebuild(new_capacity, generation, 0, [generation](const void *entry) {
+        return ((const Cache_entry *)entry)->last_seen == generation;
+    }, error);
+}
+
+bool Cache::close(std::string &error) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!table_.is_open()) {
+        return true;
+    }
+    // отметки поколения пишутся и при одних поисках, поэтому сбрасывается вся таблица
+    bool ok = table_.sync(error);
+    table_.close();
+    return ok;
+}
+
+Counters Cache::counters() const {
+    Counters result;
+    result.hits = hits_;
+    result.misses = misses_;
+    result.verified = verified_;
+    result.mismatches = mismatches_;
+    result.stored = stored_;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    result.entries = table_.is_open() ? table_.header()->count : 0;
+    return result;
+}
+
+std::string Cache::error() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return error_;
+}
+
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "mapped_table.h"
+
+/**
+ * Постоянный кэш дайджестов файлов для повторных прогонов по большим деревьям.
+ *
+ * Запись ищется по (устройство, inode, размер дайджеста) и действительна, пока совпадают размер
+ * файла, mtime и ctime в наносекундах; изменившийся файл занимает ту же запись. Таблица хранится
+ * в mapped_table: поиск идёт под разделяемой блокировкой из любого числа потоков, запись и рост
+ * таблицы -- под исключительной. Между процессами файл делится через flock: пока кэш открыт
+ * одним процессом, open в другом ждёт.
+ *
+ * Кэш -- только ускорение: после сбоя во время записи (нет отметки clean) он открывается пустым,
+ * а ошибки записи отключают обновление, но не хеширование.
+ */
+namespace digest_cache {
+
+const size_t max_digest_size = 64;
+
+struct Key {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint64_t ctime_ns;
+};
+
+Key key_of(const struct stat &info);
+
+/**
+ * Что делать с найденными записями.
+ */
+struct Policy {
+    bool trust = false;             // false -- всё хешируется заново, кэш только обновляется
+    double verify_fraction = 0;     // доля попаданий, которые всё равно пересчитываются и сверяются
+};
+
+enum Lookup_result {
+    miss,
+    hit,        // digest можно использовать без чтения файла
+    verify      // digest найден, но файл нужно перехешировать и сверить (record с expected)
+};
+
+struct Counters {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t verified = 0;
+    uint64_t mismatches = 0;    // проверка или режим без доверия нашли другой дайджест
+    uint64_t stored = 0;
+    uint64_t entries = 0;
+};
+
+/**
+ * Записи кэша по 128 байт, поколение -- в поле tag заголовка. Каждое открытие -- новое поколение;
+ * найденные и записанные записи помечаются им, compact оставляет только записи текущего поколения.
+ */
+class Cache {
+public:
+    Cache();
+    Cache(const Cache &) = delete;
+    Cache &operator=(const Cache &) = delete;
+
+    ~Cache();
+
+    /**
+     * Открывает или создаёт кэш. Файл чужого формата -- ошибка, незакрытый после сбоя -- пустой кэш.
+     * Если кэш открыт другим процессом, ждёт его close.
+     */
+    bool open(const std::string &path, const Policy &policy, std::string &error);
+
+    Lookup_result lookup(const Key &key, size_t hash_bits, uint8_t *digest);
+
+    /**
+     * Сохраняет дайджест, вычисленный после промаха или для verify; expected -- дайджест из кэша
+     * (nullptr, если его не было). false -- дайджест с ним не совпал: расхождение учитывается
+     * в mismatches, а запись остаётся прежней, чтобы подозрительный дайджест не стал эталоном.
+     * Файлы, изменённые меньше секунды назад, не сохраняются: следующая запись в тот же момент
+     * времени не изменила бы ключ.
+     */
+    bool record(const Key &key, size_t hash_bits, const uint8_t *digest, const uint8_t *expected);
+
+    /**
+     * Атомарно заменяет файл таблицей только из записей, найденных или записанных в этом прогоне:
+     * удалённые и не затронутые прогоном файлы пропадают.
+     */
+    bool compact(std::string &error);
+
+    /**
+     * Сбрасывает таблицу на диск и помечает её согласованной.
+     */
+    bool close(std::string &error);
+
+    Counters counters() const;
+
+    /**
+     * Первая ошибка записи, после которой кэш перестал обновляться (пусто, если её не было).
+     */
+    std::string error() const;
+
+private:
+    mapped_table::Table table_;
+    Policy policy_;
+    uint32_t generation_ = 0;
+
+    mutable std::shared_mutex mutex_;
+    std::string error_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> verified_{0};
+    std::atomic<uint64_t> mismatches_{0};
+    std::atomic<uint64_t> stored_{0};
+};
+
+};
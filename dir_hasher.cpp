@@ -0,0 +1,621 @@
+#include "dir_hasher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "read_backend.h"
+#include "streebog.h"
+#include "work_stealing_pool.h"
+
+namespace dir_hasher {
+
+namespace {
+
+struct Walk_entry {
+    size_t index;
+    std::string path;
+    std::string error;      // ошибка обхода (например, нет доступа к каталогу)
+};
+
+/**
+ * Обход в отдельном потоке; очередь ограничена, чтобы обход не убегал далеко вперёд чтения.
+ */
+class Walker {
+public:
+    static const size_t capacity = 4096;
+
+    explicit Walker(const std::vector<std::string> &roots) : thread_([this, roots] { walk_all(roots); }) {
+    }
+
+    ~Walker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancelled_ = true;
+        }
+        has_space_.notify_all();
+        thread_.join();
+    }
+
+    /**
+     * Не блокируется; false, если очередь сейчас пуста.
+     */
+    bool try_pop(Walk_entry &entry) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty()) {
+            return false;
+        }
+        entry = std::move(queue_.front());
+        queue_.pop_front();
+        has_space_.notify_one();
+        return true;
+    }
+
+    bool finished() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return finished_ && queue_.empty();
+    }
+
+    size_t queued() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+    /**
+     * Ждёт нового элемента или конца обхода, но не дольше timeout.
+     */
+    void wait(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        has_entries_.wait_for(lock, timeout, [this] { return finished_ || !queue_.empty(); });
+    }
+
+private:
+
+    void push(std::string path, std::string error = "") {
+        std::unique_lock<std::mutex> lock(mutex_);
+        has_space_.wait(lock, [this] { return cancelled_ || queue_.size() < capacity; });
+        queue_.push_back({next_index_++, std::move(path), std::move(error)});
+        has_entries_.notify_one();
+    }
+
+    void walk_directory(const std::string &path) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            push(path, strerror(errno));
+            return;
+        }
+
+        std::vector<std::pair<std::string, unsigned char> > children;
+        while (auto entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            children.emplace_back(entry->d_name, entry->d_type);
+        }
+        closedir(dir);
+        std::sort(children.begin(), children.end());
+
+        auto prefix = path.back() == '/' ? path : path + "/";
+        for (const auto &child : children) {
+            auto child_path = prefix + child.first;
+            auto type = child.second;
+            if (type == DT_UNKNOWN) {
+                struct stat info;
+                if (lstat(child_path.c_str(), &info) != 0) {
+                    push(child_path, strerror(errno));
+                    continue;
+                }
+                type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_DIR) {
+                walk_directory(child_path);
+            } else if (type == DT_REG) {
+                push(child_path);
+            }
+            // символические ссылки, устройства и сокеты пропускаются
+        }
+    }
+
+    void walk_all(const std::vector<std::string> &roots) {
+        for (const auto &root : roots) {
+            struct stat info;
+            if (stat(root.c_str(), &info) != 0) {
+                push(root, strerror(errno));
+            } else if (S_ISDIR(info.st_mode)) {
+                walk_directory(root);
+            } else {
+                push(root);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        has_entries_.notify_all();
+    }
+
+    std::mutex mutex_;
+    std::condition_variable has_entries_;
+    std::condition_variable has_space_;
+    std::deque<Walk_entry> queue_;
+    size_t next_index_ = 0;
+    bool finished_ = false;
+    bool cancelled_ = false;
+    std::thread thread_;
+};
+
+/**
+ * Выдаёт результаты в порядке номеров, присвоенных при обходе.
+ */
+class Ordered_results {
+public:
+    explicit Ordered_results(const Result_callback &callback) : callback_(callback) {
+    }
+
+    void emit(size_t index, const std::string &path, const uint8_t *digest, size_t digest_size,
+              const std::string &error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &result = pending_[index];
+        result.path = path;
+        result.ok = digest != nullptr;
+        if (result.ok) {
+            result.digest.assign(digest, digest + digest_size);
+        }
+        result.error = error;
+
+        while (!pending_.empty() && pending_.begin()->first == next_) {
+            const auto &ready = pending_.begin()->second;
+            callback_(ready.path, ready.ok ? ready.digest.data() : nullptr, ready.error);
+            pending_.erase(pending_.begin());
+            next_++;
+        }
+    }
+
+private:
+
+    struct Result {
+        std::string path;
+        bool ok;
+        std::vector<uint8_t> digest;
+        std::string error;
+    };
+
+    const Result_callback &callback_;
+    std::mutex mutex_;
+    std::map<size_t, Result> pending_;
+    size_t next_ = 0;
+};
+
+template<size_t hash_bits>
+class Engine {
+public:
+    struct File_job;
+
+    struct Chunk {
+        uint8_t *data;
+        std::shared_ptr<File_job> file;
+        uint64_t offset = 0;
+        size_t length = 0;
+        size_t filled = 0;
+        bool reading = false;       // чтение поставлено в очередь и ещё не завершилось
+    };
+
+    struct File_job {
+        size_t index;
+        std::string path;
+        int fd = -1;
+        uint64_t size = 0;
+
+        // поля стадии чтения, меняются только в потоке чтения
+        uint64_t issued = 0;
+        size_t reads_in_flight = 0;
+
+        std::mutex mutex;
+        std::map<uint64_t, Chunk *> ready;
+        uint64_t hashed = 0;
+        bool scheduled = false;
+        bool failed = false;
+        std::string error;
+        Streebog<hash_bits> context;
+
+        digest_cache::Key key;
+        bool verify = false;                // в кэше был дайджест, его нужно сверить с новым
+        uint8_t expected[Streebog<hash_bits>::digest_size];
+    };
+
+    Engine(const Options &options, const Result_callback &callback)
+            : options_(options), results_(callback), pool_(options.threads),
+              storage_(new uint8_t[options.buffers * options.chunk_size]), chunks_(options.buffers) {
+        for (size_t i = 0; i < options.buffers; i++) {
+            chunks_[i].data = storage_.get() + i * options.chunk_size;
+            free_chunks_.push_back(&chunks_[i]);
+        }
+        if (options.use_uring) {
+            backend_ = read_backend::make_uring((unsigned)options.buffers);
+        }
+        if (!backend_) {
+            backend_ = read_backend::make_pread((unsigned)std::min<size_t>(options.buffers, 8));
+        }
+        report_.backend = backend_->name();
+    }
+
+    Report run(const std::vector<std::string> &roots) {
+        auto time_begin = std::chrono::steady_clock::now();
+
+        Walker walker(roots);
+        std::deque<std::shared_ptr<File_job> > open_files;
+        std::vector<read_backend::Completion> completions;
+        size_t in_flight = 0;
+
+        while (true) {
+            Walk_entry entry;
+            while (open_files.size() < options_.max_open_files && walker.try_pop(entry)) {
+                open_file(entry, open_files);
+            }
+
+            // файлы дочитываются по порядку: на вращающемся диске это меньше перемещений головки,
+            // а упорядоченный вывод не копит готовые результаты
+            for (auto &file : open_files) {
+                while (file->issued < file->size) {
+                    auto chunk = try_take_chunk();
+                    if (chunk == nullptr) {
+                        break;
+                    }
+                    chunk->file = file;
+                    chunk->offset = file->issued;
+                    chunk->length = (size_t)std::min<uint64_t>(options_.chunk_size, file->size - file->issued);
+                    chunk->filled = 0;
+                    submit(chunk);
+                    file->issued += chunk->length;
+                    file->reads_in_flight++;
+                    in_flight++;
+                }
+            }
+
+            sample(walker, in_flight);
+
+            if (in_flight > 0) {
+                completions.clear();
+                std::string error;
+                if (!backend_->wait(completions, error)) {
+                    fall_back(completions, error);
+                }
+                for (const auto &completion : completions) {
+                    in_flight -= complete(completion, open_files);
+                }
+            } else if (!open_files.empty()) {
+                wait_for_chunk();
+            } else if (!walker.finished()) {
+                walker.wait(std::chrono::milliseconds(100));
+            } else {
+                break;
+            }
+        }
+
+        pool_.wait();
+
+        report_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_begin).count();
+        report_.steals = pool_.steals();
+        return report_;
+    }
+
+private:
+
+    void open_file(const Walk_entry &entry, std::deque<std::shared_ptr<File_job> > &open_files) {
+        if (!entry.error.empty()) {
+            fail(entry.index, entry.path, entry.error);
+            return;
+        }
+
+        auto file = std::make_shared<File_job>();
+        file->index = entry.index;
+        file->path = entry.path;
+
+        // попадание в кэш стоит одного stat: файл не открывается и не читается
+        struct stat info;
+        digest_cache::Key cached_key = {};
+        if (options_.cache != nullptr && stat(entry.path.c_str(), &info) == 0) {
+            cached_key = digest_cache::key_of(info);
+            auto found = options_.cache->lookup(cached_key, hash_bits, file->expected);
+            if (found == digest_cache::hit) {
+                {
+                    std::lock_guard<std::mutex> lock(stats_mutex_);
+                    report_.files++;
+                    report_.cached++;
+                }
+                results_.emit(entry.index, entry.path, file->expected, sizeof(file->expected), "");
+                return;
+            }
+            file->verify = found == digest_cache::verify;
+        }
+
+        file->fd = open(entry.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file->fd < 0 || fstat(file->fd, &info) != 0) {
+            auto error = strerror(errno);
+            if (file->fd >= 0) {
+                close(file->fd);
+            }
+            fail(entry.index, entry.path, error);
+            return;
+        }
+        file->size = (uint64_t)info.st_size;
+        file->key = digest_cache::key_of(info);
+        // файл заменили между stat и open -- сверять не с чем
+        file->verify = file->verify && memcmp(&file->key, &cached_key, sizeof(cached_key)) == 0;
+        posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if (file->size == 0) {
+            close(file->fd);
+            pool_.submit([this, file] { finish(*file); });
+            return;
+        }
+        open_files.push_back(file);
+    }
+
+    /**
+     * Заменяет сломавшуюся очередь чтения пулом pread и ставит в него все чтения, не вернувшиеся
+     * из старой. Такое чтение может ещё выполняться в ядре и дописать свой буфер когда угодно,
+     * даже после закрытия кольца, поэтому его чанк получает новый буфер, а старые буферы
+     * и старая очередь не освобождаются до конца процесса.
+     */
+    void fall_back(const std::vector<read_backend::Completion> &completions, const std::string &error) {
+        std::cerr << error << ", falling back to pread" << std::endl;
+        for (const auto &completion : completions) {
+            chunks_[completion.tag].reading = false;
+        }
+        bool abandoned = false;
+        for (auto &chunk : chunks_) {
+            if (chunk.reading) {
+                auto data = new uint8_t[options_.chunk_size];
+                memcpy(data, chunk.data, chunk.filled);
+                replaced_.emplace_back(data);
+                chunk.data = data;
+                abandoned = true;
+            }
+        }
+        if (abandoned) {
+            storage_.release();
+            backend_.release();
+        }
+        backend_ = read_backend::make_pread((unsigned)std::min<size_t>(options_.buffers, 8));
+        report_.backend = backend_->name();
+        for (auto &chunk : chunks_) {
+            if (chunk.reading) {
+                submit(&chunk);
+            }
+        }
+    }
+
+    void submit(Chunk *chunk) {
+        chunk->reading = true;
+        backend_->submit({chunk->file->fd, chunk->data + chunk->filled, chunk->length - chunk->filled,
+                          chunk->offset + chunk->filled, (uint64_t)(chunk - chunks_.data())});
+    }
+
+    /**
+     * Обрабатывает одно завершение чтения; возвращает 1, если чтение ушло из полёта.
+     */
+    size_t complete(const read_backend::Completion &completion,
+                    std::deque<std::shared_ptr<File_job> > &open_files) {
+        auto chunk = &chunks_[completion.tag];
+        auto file = chunk->file;
+        chunk->reading = false;
+
+        if (completion.result > 0) {
+            chunk->filled += (size_t)completion.result;
+            if (chunk->filled < chunk->length) {
+                // короткое чтение -- дочитываем остаток в тот же буфер
+                submit(chunk);
+                return 0;
+            }
+            deliver(chunk);
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(file->mutex);
+                if (!file->failed) {
+                    file->failed = true;
+                    file->error = completion.result < 0 ? strerror((int)-completion.result) : "file shrank while reading";
+                }
+            }
+            release_chunk(chunk);
+        }
+
+        file->reads_in_flight--;
+        if (file->reads_in_flight == 0 && (file->issued == file->size || file->failed)) {
+            close(file->fd);
+            open_files.erase(std::find(open_files.begin(), open_files.end(), file));
+            if (file->failed) {
+                // после ошибки новые чтения не ставятся, ожидающие блоки освободит drain
+                schedule(*file, file);
+                fail(file->index, file->path, file->error);
+            }
+        } else if (file->failed) {
+            file->issued = file->size;
+        }
+        return 1;
+    }
+
+    void deliver(Chunk *chunk) {
+        auto file = chunk->file;
+        std::lock_guard<std::mutex> lock(file->mutex);
+        if (file->failed) {
+            release_chunk(chunk);
+            return;
+        }
+        file->ready[chunk->offset] = chunk;
+        schedule_locked(*file, file);
+    }
+
+    void schedule(File_job &file, const std::shared_ptr<File_job> &owner) {
+        std::lock_guard<std::mutex> lock(file.mutex);
+        schedule_locked(file, owner);
+    }
+
+    void schedule_locked(File_job &file, const std::shared_ptr<File_job> &owner) {
+        if (!file.scheduled) {
+            file.scheduled = true;
+            pool_.submit([this, owner] { drain(*owner); });
+        }
+    }
+
+    /**
+     * Хеширует готовые блоки файла по порядку смещений; одновременно файл обрабатывает
+     * не больше одного потока.
+     */
+    void drain(File_job &file) {
+        while (true) {
+            Chunk *chunk;
+            {
+                std::lock_guard<std::mutex> lock(file.mutex);
+                if (file.failed) {
+                    for (auto &ready : file.ready) {
+                        release_chunk(ready.second);
+                    }
+                    file.ready.clear();
+                    file.scheduled = false;
+                    return;
+                }
+                auto it = file.ready.find(file.hashed);
+                if (it == file.ready.end()) {
+                    file.scheduled = false;
+                    return;
+                }
+                chunk = it->second;
+                file.ready.erase(it);
+            }
+
+            file.context.update(chunk->data, chunk->length);
+            auto length = chunk->length;
+            release_chunk(chunk);
+
+            bool done;
+            {
+                std::lock_guard<std::mutex> lock(file.mutex);
+                file.hashed += length;
+                done = file.hashed == file.size;
+            }
+            if (done) {
+                finish(file);
+                return;
+            }
+        }
+    }
+
+    void finish(File_job &file) {
+        uint8_t digest[Streebog<hash_bits>::digest_size];
+        file.context.final(digest);
+        std::string warning;
+        if (options_.cache != nullptr &&
+            !options_.cache->record(file.key, hash_bits, digest, file.verify ? file.expected : nullptr)) {
+            warning = "content changed without a change in size, mtime or ctime";
+        }
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            report_.files++;
+            report_.bytes += file.size;
+        }
+        results_.emit(file.index, file.path, digest, sizeof(digest), warning);
+    }
+
+    void fail(size_t index, const std::string &path, const std::string &error) {
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            report_.failed++;
+        }
+        results_.emit(index, path, nullptr, 0, error);
+    }
+
+    Chunk *try_take_chunk() {
+        std::lock_guard<std::mutex> lock(chunks_mutex_);
+        if (free_chunks_.empty()) {
+            return nullptr;
+        }
+        auto chunk = free_chunks_.back();
+        free_chunks_.pop_back();
+        return chunk;
+    }
+
+    void release_chunk(Chunk *chunk) {
+        chunk->file.reset();
+        {
+            std::lock_guard<std::mutex> lock(chunks_mutex_);
+            free_chunks_.push_back(chunk);
+        }
+        chunk_released_.notify_one();
+    }
+
+    void wait_for_chunk() {
+        std::unique_lock<std::mutex> lock(chunks_mutex_);
+        chunk_released_.wait(lock, [this] { return !free_chunks_.empty(); });
+    }
+
+    void sample(Walker &walker, size_t in_flight) {
+        size_t free_count;
+        {
+            std::lock_guard<std::mutex> lock(chunks_mutex_);
+            free_count = free_chunks_.size();
+        }
+        report_.walk_queue.sample(walker.queued());
+        report_.reads.sample(in_flight);
+        report_.hash_queue.sample(chunks_.size() - free_count - in_flight);
+        report_.pool_queue.sample(pool_.queued());
+    }
+
+    const Options &options_;
+    Ordered_results results_;
+    Work_stealing_pool pool_;
+    std::unique_ptr<read_backend::Backend> backend_;
+
+    std::unique_ptr<uint8_t[]> storage_;
+    std::vector<std::unique_ptr<uint8_t[]> > replaced_;    // буферы чанков взамен брошенных в fall_back
+    std::vector<Chunk> chunks_;
+    std::vector<Chunk *> free_chunks_;
+    std::mutex chunks_mutex_;
+    std::condition_variable chunk_released_;
+
+    std::mutex stats_mutex_;
+    Report report_;
+};
+
+};
+
+Report hash_tree(const std::vector<std::string> &roots, const Options &options, const Result_callback &callback) {
+    if (options.hash_bits == 256) {
+        Engine<256> engine(options, callback);
+        return engine.run(roots);
+    }
+    Engine<512> engine(options, callback);
+    return engine.run(roots);
+}
+
+void print_report(const Report &report) {
+    auto seconds = std::max(report.seconds, 1e-9);
+    std::cerr << "files: " << report.files << " hashed (" << report.cached << " from cache), "
+              << report.failed << " failed, "
+              << report.bytes << " bytes in " << report.seconds << " s" << std::endl
+              << "throughput: " << report.bytes / seconds / (1 << 20) << " MiB/s, "
+              << report.files / seconds << " files/s (" << report.backend << ", "
+              << report.steals << " steals)" << std::endl;
+
+    auto print_depth = [](const char *name, const Queue_depth &depth) {
+        std::cerr << "  " << name << ": avg " << depth.average() << ", max " << depth.max << std::endl;
+    };
+    std::cerr << "queue depths:" << std::endl;
+    print_depth("walk queue   ", report.walk_queue);
+    print_depth("reads        ", report.reads);
+    print_depth("hash queue   ", report.hash_queue);
+    print_depth("pool tasks   ", report.pool_queue);
+}
+
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "digest_cache.h"
+
+/**
+ * Параллельное хеширование деревьев каталогов.
+ *
+ * Конвейер из трёх стадий: обход каталогов (отдельный поток) -> чтение (io_uring или пул pread)
+ * в ограниченный набор буферов -> хеширование в пуле с кражей работы. Чтение и вычисление
+ * перекрываются, память ограничена buffers * chunk_size, а результаты выдаются в порядке обхода.
+ */
+namespace dir_hasher {
+
+struct Options {
+    size_t hash_bits = 256;
+    size_t threads = 0;             // потоки хеширования, 0 -- по числу процессоров
+    size_t chunk_size = 1 << 20;    // размер одного чтения
+    size_t buffers = 64;            // буферов (и чтений) в полёте
+    size_t max_open_files = 32;     // файлов, читаемых одновременно; 1-2 для вращающихся дисков
+    bool use_uring = true;
+    digest_cache::Cache *cache = nullptr;   // найденные в кэше файлы не читаются
+};
+
+struct Queue_depth {
+    size_t max = 0;
+    double sum = 0;
+    uint64_t samples = 0;
+
+    void sample(size_t value) {
+        max = std::max(max, value);
+        sum += (double)value;
+        samples++;
+    }
+
+    double average() const {
+        return samples == 0 ? 0 : sum / (double)samples;
+    }
+};
+
+struct Report {
+    const char *backend = "";
+    uint64_t files = 0;
+    uint64_t cached = 0;        // из них взяты из кэша без чтения
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    uint64_t steals = 0;
+
+    Queue_depth walk_queue;     // найденные, но ещё не открытые файлы
+    Queue_depth reads;          // чтения в полёте
+    Queue_depth hash_queue;     // прочитанные, но ещё не хешированные блоки
+    Queue_depth pool_queue;     // задачи, ожидающие потока хеширования
+};
+
+/**
+ * digest == nullptr означает ошибку, её текст в error. Непустой error при digest -- предупреждение:
+ * дайджест файла с неизменными метаданными не совпал с кэшем.
+ */
+using Result_callback = std::function<void(const std::string &path, const uint8_t *digest, const std::string &error)>;
+
+/**
+ * Хеширует все обычные файлы под roots (сами roots могут быть файлами). callback вызывается
+ * по одному разу на файл, последовательно и в порядке обхода (имена внутри каталога отсортированы).
+ */
+Report hash_tree(const std::vector<std::string> &roots, const Options &options, const Result_callback &callback);
+
+void print_report(const Report &report);
+
+};
@@ -0,0 +1,253 @@
+#include "drbg.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <thread>
+
+#include <sys/random.h>
+#include <unistd.h>
+
+#include "multibuffer.h"
+#include "streebog.h"
+
+namespace drbg {
+
+namespace {
+
+/**
+ * Блоков счётчика в одном вызове hash_many: кратно и 4, и 8 линиям.
+ */
+const size_t batch_blocks = 64;
+
+void wipe(void *data, size_t length) {
+    volatile uint8_t *bytes = (uint8_t *)data;
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = 0;
+    }
+}
+
+/**
+ * V += value (оба -- big-endian числа длины seed_length, value может быть короче).
+ */
+void add(uint8_t *V, const uint8_t *value, size_t length) {
+    unsigned carry = 0;
+    for (size_t i = 0; i < Hash_drbg::seed_length; i++) {
+        auto position = Hash_drbg::seed_length - 1 - i;
+        unsigned sum = V[position] + carry + (i < length ? value[length - 1 - i] : 0);
+        V[position] = (uint8_t)sum;
+        carry = sum >> 8;
+    }
+}
+
+void add(uint8_t *V, uint64_t value) {
+    uint8_t bytes[8];
+    for (size_t i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)(value >> (56 - 8 * i));
+    }
+    add(V, bytes, sizeof(bytes));
+}
+
+struct Part {
+    const uint8_t *data;
+    size_t length;
+};
+
+/**
+ * Hash_df (SP 800-90A, 10.3.1): seed_length байт из конкатенации parts.
+ */
+void hash_df(std::initializer_list<Part> parts, uint8_t *out) {
+    const uint32_t bits = Hash_drbg::seed_length * 8;
+    uint8_t header[5] = {1, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+    uint8_t block[Hash_drbg::block_size];
+    for (size_t offset = 0; offset < Hash_drbg::seed_length; offset += sizeof(block), header[0]++) {
+        Streebog_512 context;
+        context.update(header, sizeof(header));
+        for (const auto &part : parts) {
+            if (part.length > 0) {
+                context.update(part.data, part.length);
+            }
+        }
+        context.final(block);
+        memcpy(out + offset, block, std::min(sizeof(block), Hash_drbg::seed_length - offset));
+    }
+    wipe(block, sizeof(block));
+}
+
+};
+
+Hash_drbg::~Hash_drbg() {
+    wipe(V_, sizeof(V_));
+    wipe(C_, sizeof(C_));
+}
+
+bool Hash_drbg::instantiate(const uint8_t *entropy, size_t entropy_length, const uint8_t *nonce, size_t nonce_length,
+                            const uint8_t *personalization, size_t personalization_length) {
+    if (entropy_length < security_strength) {
+        return false;
+    }
+    hash_df({{entropy, entropy_length}, {nonce, nonce_length}, {personalization, personalization_length}}, V_);
+    const uint8_t zero = 0x00;
+    hash_df({{&zero, 1}, {V_, seed_length}}, C_);
+    reseed_counter_ = 1;
+    instantiated_ = true;
+    return true;
+}
+
+bool Hash_drbg::reseed(const uint8_t *entropy, size_t entropy_length, const uint8_t *additional,
+                       size_t additional_length) {
+    if (!instantiated_ || entropy_length < security_strength) {
+        return false;
+    }
+    const uint8_t one = 0x01;
+    uint8_t seed[seed_length];
+    hash_df({{&one, 1}, {V_, seed_length}, {entropy, entropy_length}, {additional, additional_length}}, seed);
+    memcpy(V_, seed, seed_length);
+    wipe(seed, seed_length);
+    const uint8_t zero = 0x00;
+    hash_df({{&zero, 1}, {V_, seed_length}}, C_);
+    reseed_counter_ = 1;
+    return true;
+}
+
+bool Hash_drbg::generate(uint8_t *out, size_t length, const uint8_t *additional, size_t additional_length) {
+    if (needs_reseed() || length > max_request) {
+        return false;
+    }
+
+    if (additional_length > 0) {
+        const uint8_t prefix = 0x02;
+        uint8_t w[block_size];
+        Streebog_512 context;
+        context.update(&prefix, 1);
+        context.update(V_, seed_length);
+        context.update(additional, additional_length);
+        context.final(w);
+        add(V_, w, sizeof(w));
+    }
+
+    // Hashgen: блоки Hash(V + i) считаются пачками; полные блоки пишутся прямо в out
+    uint8_t messages[batch_blocks][seed_length];
+    const uint8_t *pointers[batch_blocks];
+    size_t lengths[batch_blocks];
+    uint8_t tail[batch_blocks * block_size];
+    uint8_t data[seed_length];
+    memcpy(data, V_, seed_length);
+    for (size_t i = 0; i < batch_blocks; i++) {
+        pointers[i] = messages[i];
+        lengths[i] = seed_length;
+    }
+
+    while (length > 0) {
+        auto blocks = std::min(batch_blocks, (length + block_size - 1) / block_size);
+        for (size_t i = 0; i < blocks; i++) {
+            memcpy(messages[i], data, seed_length);
+            add(data, 1);
+        }
+        auto bytes = std::min(length, blocks * block_size);
+        if (bytes == blocks * block_size) {
+            multibuffer::hash_many(pointers, lengths, blocks, out, 512);
+        } else {
+            multibuffer::hash_many(pointers, lengths, blocks, tail, 512);
+            memcpy(out, tail, bytes);
+            wipe(tail, sizeof(tail));
+        }
+        out += bytes;
+        length -= bytes;
+    }
+    wipe(messages, sizeof(messages));
+    wipe(data, sizeof(data));
+
+    update_after_request();
+    return true;
+}
+
+void Hash_drbg::update_after_request() {
+    // V = V + Hash(0x03 || V) + C + reseed_counter
+    const uint8_t prefix = 0x03;
+    uint8_t H[block_size];
+    Streebog_512 context;
+    context.update(&prefix, 1);
+    context.update(V_, seed_length);
+    context.final(H);
+    add(V_, H, sizeof(H));
+    add(V_, C_, seed_length);
+    add(V_, reseed_counter_);
+    wipe(H, sizeof(H));
+    reseed_counter_++;
+}
+
+bool Hash_drbg::fill(uint8_t *out, size_t length) {
+    while (length > 0) {
+        auto piece = std::min(length, max_request);
+        if (!generate(out, piece)) {
+            return false;
+        }
+        out += piece;
+        length -= piece;
+    }
+    return true;
+}
+
+bool system_entropy(uint8_t *out, size_t length, std::string &error) {
+    while (length > 0) {
+        auto count = getrandom(out, length, 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = std::string("getrandom: ") + strerror(errno);
+            return false;
+        }
+        out += count;
+        length -= (size_t)count;
+    }
+    return true;
+}
+
+bool random_bytes(uint8_t *out, size_t length, std::string &error) {
+    static thread_local Hash_drbg generator;
+    static thread_local pid_t seeded_pid = 0;
+
+    // после fork потомок получает копию состояния и без reseed повторил бы вывод родителя
+    uint8_t entropy[Hash_drbg::security_strength * 3 / 2];
+    auto pid = getpid();
+    while (length > 0) {
+        if (generator.needs_reseed() || seeded_pid != pid) {
+            if (!system_entropy(entropy, sizeof(entropy), error)) {
+                return false;
+            }
+            bool seeded;
+            if (generator.reseed_counter() == 0) {
+                // nonce различает потоки, даже если бы энтропия совпала
+                struct {
+                    uint64_t time;
+                    size_t thread;
+                    const void *instance;
+                } nonce = {(uint64_t)std::chrono::steady_clock::now().time_since_epoch().count(),
+                           std::hash<std::thread::id>()(std::this_thread::get_id()), &generator};
+                const char personalization[] = "stribog random_bytes";
+                seeded = generator.instantiate(entropy, sizeof(entropy), (const uint8_t *)&nonce, sizeof(nonce),
+                                               (const uint8_t *)personalization, sizeof(personalization) - 1);
+            } else {
+                seeded = generator.reseed(entropy, sizeof(entropy), (const uint8_t *)&pid, sizeof(pid));
+            }
+            wipe(entropy, sizeof(entropy));
+            if (!seeded) {
+                error = "DRBG seeding failed";
+                return false;
+            }
+            seeded_pid = pid;
+        }
+        auto piece = std::min(length, Hash_drbg::max_request);
+        generator.generate(out, piece);
+        out += piece;
+        length -= piece;
+    }
+    return true;
+}
+
+};
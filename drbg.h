@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Детерминированный генератор случайных битов Hash_DRBG (NIST SP 800-90A, 10.1.1)
+ * с функцией хеширования Streebog-512: outlen = 512 бит, seedlen = 888 бит, как у SHA-512.
+ *
+ * Выход одного запроса -- Hash(V), Hash(V + 1), Hash(V + 2), ...: блоки счётчика независимы,
+ * поэтому хешируются пачками многобуферным движком (multibuffer::hash_many), а не по одному.
+ */
+namespace drbg {
+
+class Hash_drbg {
+public:
+    static constexpr size_t seed_length = 111;              // seedlen / 8
+    static constexpr size_t block_size = 64;                // outlen / 8
+    static constexpr size_t security_strength = 32;         // байт энтропии не меньше этого
+    static constexpr size_t max_request = 1 << 16;          // 2^19 бит на один generate
+    static constexpr uint64_t default_reseed_interval = 1ULL << 24;
+
+    Hash_drbg() = default;
+    Hash_drbg(const Hash_drbg &) = delete;
+    Hash_drbg &operator=(const Hash_drbg &) = delete;
+
+    ~Hash_drbg();
+
+    /**
+     * false, если энтропии меньше security_strength байт.
+     */
+    bool instantiate(const uint8_t *entropy, size_t entropy_length, const uint8_t *nonce, size_t nonce_length,
+                     const uint8_t *personalization = nullptr, size_t personalization_length = 0);
+
+    bool reseed(const uint8_t *entropy, size_t entropy_length, const uint8_t *additional = nullptr,
+                size_t additional_length = 0);
+
+    /**
+     * Один запрос SP 800-90A, не больше max_request байт. false, если генератор не инициализирован
+     * или счётчик запросов исчерпан -- тогда нужен reseed.
+     */
+    bool generate(uint8_t *out, size_t length, const uint8_t *additional = nullptr, size_t additional_length = 0);
+
+    /**
+     * Заполняет буфер любой длины последовательностью запросов по max_request байт.
+     */
+    bool fill(uint8_t *out, size_t length);
+
+    bool needs_reseed() const {
+        return !instantiated_ || reseed_counter_ > reseed_interval_;
+    }
+
+    /**
+     * Число запросов generate с последнего instantiate / reseed, плюс один (как reseed_counter в стандарте).
+     */
+    uint64_t reseed_counter() const {
+        return reseed_counter_;
+    }
+
+    void set_reseed_interval(uint64_t requests) {
+        reseed_interval_ = requests;
+    }
+
+private:
+    void update_after_request();
+
+    uint8_t V_[seed_length] = {};
+    uint8_t C_[seed_length] = {};
+    uint64_t reseed_counter_ = 0;
+    uint64_t reseed_interval_ = default_reseed_interval;
+    bool instantiated_ = false;
+};
+
+/**
+ * Энтропия из getrandom(2); false и описание в error, если ядро её не выдало.
+ */
+bool system_entropy(uint8_t *out, size_t length, std::string &error);
+
+/**
+ * Генератор текущего потока: инициализируется энтропией ядра при первом обращении
+ * и сам выполняет reseed, когда счётчик запросов исчерпан или процесс сменился после fork.
+ */
+bool random_bytes(uint8_t *out, size_t length, std::string &error);
+
+};
@@ -0,0 +1,110 @@
+#include "file_hash.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "streebog.h"
+
+namespace file_hash {
+
+namespace {
+
+const size_t read_buffer_size = 256 * 1024;
+
+template<typename Context>
+bool hash_stream(int fd, uint8_t *out, std::string &error) {
+    static thread_local uint8_t buffer[read_buffer_size];
+
+    Context context;
+    while (true) {
+        ssize_t length;
+        {
+            STRIBOG_STATS_TIME(io);
+            length = read(fd, buffer, read_buffer_size);
+        }
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = strerror(errno);
+            return false;
+        }
+        if (length == 0) {
+            break;
+        }
+        context.update(buffer, (size_t)length);
+    }
+    context.final(out);
+    return true;
+}
+
+template<typename Context>
+bool hash_mapped(int fd, size_t size, uint8_t *out, std::string &error) {
+    Mapped_file file;
+    if (!file.map(fd, size)) {
+        // например, файловая система без поддержки mmap -- читаем обычным путём
+        return hash_stream<Context>(fd, out, error);
+    }
+    Context::hash(file.data(), file.size(), out);
+    return true;
+}
+
+template<typename Context>
+bool hash_fd_impl(int fd, uint8_t *out, std::string &error) {
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && (size_t)info.st_size >= mmap_threshold) {
+        return hash_mapped<Context>(fd, (size_t)info.st_size, out, error);
+    }
+    return hash_stream<Context>(fd, out, error);
+}
+
+};
+
+Mapped_file::~Mapped_file() {
+    if (data_ != nullptr) {
+        munmap((void *)data_, size_);
+    }
+}
+
+bool Mapped_file::map(int fd, size_t size) {
+    auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    data_ = (const uint8_t *)data;
+    size_ = size;
+    return true;
+}
+
+bool hash_fd(int fd, size_t hash_bits, uint8_t *out, std::string &error) {
+    if (hash_bits == 256) {
+        return hash_fd_impl<Streebog_256>(fd, out, error);
+    }
+    if (hash_bits == pair_bits) {
+        return hash_fd_impl<Streebog_pair>(fd, out, error);
+    }
+    return hash_fd_impl<Streebog_512>(fd, out, error);
+}
+
+bool hash_path(const std::string &path, size_t hash_bits, uint8_t *out, std::string &error) {
+    if (path == "-") {
+        return hash_fd(STDIN_FILENO, hash_bits, out, error);
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = strerror(errno);
+        return false;
+    }
+    auto result = hash_fd(fd, hash_bits, out, error);
+    close(fd);
+    return result;
+}
+
+};
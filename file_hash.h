@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * Хеширование файлов и потоков.
+ *
+ * Большие обычные файлы отображаются в память целиком (mmap + MADV_SEQUENTIAL) и хешируются без
+ * копирования; небольшие файлы, каналы и стандартный ввод читаются блоками через read().
+ */
+namespace file_hash {
+
+/**
+ * Файлы от этого размера и больше отображаются в память.
+ */
+const size_t mmap_threshold = 1 << 20;
+
+/**
+ * Файл, отображённый в память только для чтения с MADV_SEQUENTIAL.
+ */
+class Mapped_file {
+public:
+    Mapped_file() = default;
+    Mapped_file(const Mapped_file &) = delete;
+    Mapped_file &operator=(const Mapped_file &) = delete;
+
+    ~Mapped_file();
+
+    /**
+     * false, если файл нельзя отобразить (например, файловая система без mmap).
+     */
+    bool map(int fd, size_t size);
+
+    const uint8_t *data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * hash_bits для обоих дайджестов за одно чтение (Streebog_pair): в out записываются 32 байта
+ * Streebog-256 и за ними 64 байта Streebog-512.
+ */
+const size_t pair_bits = 256 + 512;
+
+/**
+ * Записывает hash_bits / 8 байт дайджеста в out. Путь "-" означает стандартный ввод.
+ * При ошибке возвращает false и описание в error.
+ */
+bool hash_path(const std::string &path, size_t hash_bits, uint8_t *out, std::string &error);
+
+bool hash_fd(int fd, size_t hash_bits, uint8_t *out, std::string &error);
+
+};
@@ -0,0 +1,800 @@
+#include "hash_daemon.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <map>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "file_hash.h"
+#include "hmac.h"
+#include "multibuffer.h"
+#include "streebog.h"
+
+namespace hash_daemon {
+
+namespace {
+
+const size_t max_digest_size = 64;
+const size_t read_buffer_size = 64 * 1024;
+const int required_seals = F_SEAL_SHRINK | F_SEAL_WRITE;
+
+std::atomic<bool> stop_requested(false);
+
+void request_stop(int) {
+    stop_requested = true;
+}
+
+bool make_address(const std::string &path, sockaddr_un &address, std::string &error) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "socket path is too long";
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/**
+ * Отправляет все векторы целиком; passed_fd (если >= 0) уходит вместе с первым байтом.
+ */
+bool send_vectors(int fd, iovec *vectors, size_t count, int passed_fd) {
+    char control[CMSG_SPACE(sizeof(int))];
+    while (count > 0) {
+        msghdr message = {};
+        message.msg_iov = vectors;
+        message.msg_iovlen = count;
+        if (passed_fd >= 0) {
+            memset(control, 0, sizeof(control));
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            auto header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(header), &passed_fd, sizeof(int));
+        }
+
+        auto sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        passed_fd = -1;
+        auto left = (size_t)sent;
+        while (count > 0 && left >= vectors->iov_len) {
+            left -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (uint8_t *)vectors->iov_base + left;
+            vectors->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+/**
+ * Буферизованное чтение из сокета вместе с переданными дескрипторами: дескрипторы выдаются
+ * в порядке поступления, по одному на запрос с флагом payload_memfd.
+ */
+class Reader {
+public:
+    explicit Reader(int fd) : fd_(fd), buffer_(read_buffer_size) {
+    }
+
+    ~Reader() {
+        for (auto passed : fds_) {
+            close(passed);
+        }
+    }
+
+    /**
+     * false -- соединение закрыто или ошибка чтения.
+     */
+    bool read(uint8_t *out, size_t length) {
+        while (length > 0) {
+            if (begin_ == end_) {
+                if (length >= buffer_.size()) {
+                    // большие данные читаем сразу на место
+                    auto result = receive(out, length);
+                    if (result <= 0) {
+                        return false;
+                    }
+                    out += result;
+                    length -= (size_t)result;
+                    continue;
+                }
+                auto result = receive(buffer_.data(), buffer_.size());
+                if (result <= 0) {
+                    return false;
+                }
+                begin_ = 0;
+                end_ = (size_t)result;
+            }
+            auto chunk = std::min(length, end_ - begin_);
+            memcpy(out, buffer_.data() + begin_, chunk);
+            begin_ += chunk;
+            out += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+
+    /**
+     * Следующий переданный дескриптор или -1.
+     */
+    int take_fd() {
+        if (fds_.empty()) {
+            return -1;
+        }
+        auto passed = fds_.front();
+        fds_.pop_front();
+        return passed;
+    }
+
+private:
+    ssize_t receive(uint8_t *out, size_t length) {
+        char control[CMSG_SPACE(4 * sizeof(int))];
+        iovec vector = {out, length};
+        msghdr message = {};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t result;
+        do {
+            result = recvmsg(fd_, &message, MSG_CMSG_CLOEXEC);
+        } while (result < 0 && errno == EINTR);
+
+        for (auto header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+                auto count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < count; i++) {
+                    int passed;
+                    memcpy(&passed, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+                    fds_.push_back(passed);
+                }
+            }
+        }
+        return result;
+    }
+
+    int fd_;
+    std::vector<uint8_t> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    std::deque<int> fds_;
+};
+
+/**
+ * Собирает небольшие запросы hash от всех соединений в пакеты для multibuffer::hash_many.
+ *
+ * Отдельного потока нет: поток соединения, заставший пакетировщик свободным, сам становится
+ * ведущим -- ждёт попутчиков не дольше batch_window (или пока их не станет batch_limit),
+ * хеширует весь пакет и будит остальных. Пока ведущий хеширует, новые запросы копятся
+ * в следующий пакет, так что под нагрузкой пакеты набираются и без ожидания.
+ */
+class Batcher {
+public:
+    explicit Batcher(const Server_options &options) : options_(options) {
+    }
+
+    void hash(const uint8_t *data, size_t length, size_t hash_bits, uint8_t *out) {
+        Job job = {data, length, hash_bits, out, false};
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.push_back(&job);
+        has_jobs_.notify_one();
+
+        while (!job.done) {
+            if (leader_active_) {
+                done_.wait(lock);
+                continue;
+            }
+
+            leader_active_ = true;
+            if (options_.batch_window.count() > 0) {
+                has_jobs_.wait_for(lock, options_.batch_window, [this] {
+                    return pending_.size() >= options_.batch_limit;
+                });
+            }
+            auto count = std::min(pending_.size(), options_.batch_limit);
+            batch_.assign(pending_.begin(), pending_.begin() + (long)count);
+            pending_.erase(pending_.begin(), pending_.begin() + (long)count);
+            lock.unlock();
+
+            hash_batch();
+
+            lock.lock();
+            for (auto done : batch_) {
+                done->done = true;
+            }
+            batches_++;
+            requests_ += batch_.size();
+            leader_active_ = false;
+            done_.notify_all();
+        }
+    }
+
+    uint64_t batches() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return batches_;
+    }
+
+    uint64_t requests() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return requests_;
+    }
+
+private:
+    struct Job {
+        const uint8_t *data;
+        size_t length;
+        size_t hash_bits;
+        uint8_t *out;
+        bool done;
+    };
+
+    /**
+     * Вызывается только ведущим, поэтому буферы общие.
+     */
+    void hash_batch() {
+        for (size_t hash_bits = 256; hash_bits <= 512; hash_bits += 256) {
+            messages_.clear();
+            lengths_.clear();
+            for (auto job : batch_) {
+                if (job->hash_bits == hash_bits) {
+                    messages_.push_back(job->data);
+                    lengths_.push_back(job->length);
+                }
+            }
+            if (messages_.empty()) {
+                continue;
+            }
+            const size_t digest_size = hash_bits / 8;
+            digests_.resize(messages_.size() * digest_size);
+            multibuffer::hash_many(messages_.data(), lengths_.data(), messages_.size(), digests_.data(), hash_bits);
+            size_t index = 0;
+            for (auto job : batch_) {
+                if (job->hash_bits == hash_bits) {
+                    memcpy(job->out, digests_.data() + index++ * digest_size, digest_size);
+                }
+            }
+        }
+    }
+
+    const Server_options &options_;
+    std::mutex mutex_;
+    std::condition_variable has_jobs_;
+    std::condition_variable done_;
+    std::vector<Job *> pending_;
+    bool leader_active_ = false;
+    uint64_t batches_ = 0;
+    uint64_t requests_ = 0;
+
+    std::vector<Job *> batch_;
+    std::vector<const uint8_t *> messages_;
+    std::vector<size_t> lengths_;
+    std::vector<uint8_t> digests_;
+};
+
+/**
+ * Ключ HMAC последнего запроса соединения: клиенты обычно повторяют один ключ, и промежуточные
+ * состояния ipad / opad тогда не пересчитываются.
+ */
+class Hmac_cache {
+public:
+    void mac(size_t hash_bits, const std::vector<uint8_t> &key, const uint8_t *data, size_t length, uint8_t *out) {
+        if (hash_bits != hash_bits_ || key != key_) {
+            key_ = key;
+            hash_bits_ = hash_bits;
+            if (hash_bits == 256) {
+                hmac_256_.set_key(key.data(), key.size());
+            } else {
+                hmac_512_.set_key(key.data(), key.size());
+            }
+        }
+        if (hash_bits == 256) {
+            hmac_256_.mac(data, length, out);
+        } else {
+            hmac_512_.mac(data, length, out);
+        }
+    }
+
+private:
+    std::vector<uint8_t> key_;
+    size_t hash_bits_ = 0;
+    Hmac_256 hmac_256_;
+    Hmac_512 hmac_512_;
+};
+
+class Server {
+public:
+    explicit Server(const Server_options &options) : options_(options), batcher_(options) {
+    }
+
+    /**
+     * Принимает соединения до сигнала остановки; затем закрывает их и дожидается потоков.
+     * Пока открыто max_connections соединений, новые ждут в очереди listen.
+     */
+    void accept_loop(int listen_fd) {
+        while (!stop_requested) {
+            join_finished();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (connections_.size() >= options_.max_connections) {
+                    closed_.wait_for(lock, std::chrono::milliseconds(200));
+                    continue;
+                }
+            }
+            pollfd descriptor = {listen_fd, POLLIN, 0};
+            if (poll(&descriptor, 1, 200) <= 0) {
+                continue;
+            }
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_[fd] = std::thread([this, fd] { serve_connection(fd); });
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (auto &connection : connections_) {
+                shutdown(connection.first, SHUT_RDWR);
+            }
+            closed_.wait(lock, [this] { return finished_.size() == connections_.size(); });
+        }
+        join_finished();
+    }
+
+    void print_summary() {
+        auto requests = total_requests_.load();
+        auto batched = batcher_.requests();
+        auto batches = batcher_.batches();
+        std::cerr << "served " << requests << " requests, " << batched << " in " << batches << " batches";
+        if (batches > 0) {
+            std::cerr << " (" << (double)batched / (double)batches << " per batch)";
+        }
+        std::cerr << std::endl;
+    }
+
+private:
+    void serve_connection(int fd) {
+        {
+            Reader reader(fd);
+            Hmac_cache hmac;
+            std::vector<uint8_t> key;
+            std::vector<uint8_t> expected;
+            std::vector<uint8_t> payload;
+
+            Request_header request;
+            while (reader.read((uint8_t *)&request, sizeof(request)) && request.magic == request_magic) {
+                Response_header response = {response_magic, status_ok, 0, 0, request.request_id};
+                uint8_t digest[max_digest_size];
+
+                key.resize(request.key_length);
+                expected.resize(request.expected_length);
+                bool inline_payload = !(request.flags & payload_memfd);
+                if (inline_payload && request.payload_length > max_inline_payload) {
+                    // такой запрос нельзя пропустить, не прочитав лишнего -- закрываем соединение
+                    break;
+                }
+                if (!reader.read(key.data(), key.size()) || !reader.read(expected.data(), expected.size())) {
+                    break;
+                }
+                if (inline_payload) {
+                    payload.resize(request.payload_length);
+                    if (!reader.read(payload.data(), payload.size())) {
+                        break;
+                    }
+                }
+                int payload_fd = inline_payload ? -1 : reader.take_fd();
+
+                response.status = process(request, payload_fd, key, expected, payload, hmac, digest,
+                                          response.digest_length);
+                if (payload_fd >= 0) {
+                    close(payload_fd);
+                }
+                total_requests_++;
+
+                iovec vectors[2] = {{&response, sizeof(response)}, {digest, response.digest_length}};
+                if (!send_vectors(fd, vectors, 2, -1)) {
+                    break;
+                }
+            }
+        }
+
+        // дескриптор закрывает join_finished: до этого его номер не может достаться новому соединению
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_.push_back(fd);
+        closed_.notify_all();
+    }
+
+    void join_finished() {
+        std::vector<std::thread> threads;
+        std::vector<int> fds;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto fd : finished_) {
+                threads.push_back(std::move(connections_[fd]));
+                connections_.erase(fd);
+            }
+            fds.swap(finished_);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (auto fd : fds) {
+            close(fd);
+        }
+    }
+
+    Status process(const Request_header &request, int payload_fd, const std::vector<uint8_t> &key,
+                   const std::vector<uint8_t> &expected, const std::vector<uint8_t> &payload, Hmac_cache &hmac,
+                   uint8_t *digest, uint8_t &digest_length) {
+        const size_t hash_bits = request.hash_bits;
+        const size_t digest_size = hash_bits / 8;
+        if ((hash_bits != 256 && hash_bits != 512) || request.operation < operation_hash ||
+            request.operation > operation_verify || (request.operation == operation_hmac && key.empty()) ||
+            (request.operation == operation_verify && expected.size() != digest_size) ||
+            ((request.flags & payload_memfd) && payload_fd < 0)) {
+            return status_bad_request;
+        }
+
+        const uint8_t *data = payload.data();
+        size_t length = payload.size();
+        file_hash::Mapped_file file;
+        if (payload_fd >= 0) {
+            // без печатей клиент мог бы укоротить файл во время хеширования -- SIGBUS в демоне
+            struct stat info;
+            length = (size_t)request.payload_length;
+            auto seals = fcntl(payload_fd, F_GET_SEALS);
+            if (seals < 0 || (seals & required_seals) != required_seals || fstat(payload_fd, &info) != 0 ||
+                (uint64_t)info.st_size < request.payload_length) {
+                return status_bad_request;
+            }
+            if (length > 0 && !file.map(payload_fd, length)) {
+                return status_error;
+            }
+            data = file.data();
+        }
+
+        if (!key.empty()) {
+            hmac.mac(hash_bits, key, data, length, digest);
+        } else if (payload_fd < 0 && length <= options_.batch_max_payload) {
+            batcher_.hash(data, length, hash_bits, digest);
+        } else if (hash_bits == 256) {
+            Streebog_256::hash(data, length, digest);
+        } else {
+            Streebog_512::hash(data, length, digest);
+        }
+
+        if (request.operation == operation_verify) {
+            return memcmp(digest, expected.data(), digest_size) == 0 ? status_ok : status_mismatch;
+        }
+        digest_length = (uint8_t)digest_size;
+        return status_ok;
+    }
+
+    const Server_options &options_;
+    Batcher batcher_;
+    std::mutex mutex_;
+    std::condition_variable closed_;
+    std::map<int, std::thread> connections_;
+    std::vector<int> finished_;        // соединения, чьи потоки закончили работу и ждут join
+    std::atomic<uint64_t> total_requests_{0};
+};
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " --daemon SOCKET [--batch-limit N] [--batch-window USEC]"
+              << " [--batch-max-payload N] [--max-connections N]" << std::endl
+              << "       " << program << " --load SOCKET [--clients N] [--requests N] [--size N] [-a 256|512]"
+              << " [--op hash|hmac|verify] [--memfd]" << std::endl
+              << std::endl
+              << "  --daemon SOCKET        serve hash, HMAC and verify requests on a Unix socket until SIGINT/SIGTERM"
+              << std::endl
+              << "  --batch-limit N        most requests hashed together (default 64)" << std::endl
+              << "  --batch-window USEC    how long a batch waits for more requests (default 0)" << std::endl
+              << "  --batch-max-payload N  larger payloads are hashed at once, unbatched (default 4096)" << std::endl
+              << "  --max-connections N    connections served at once, others wait to be accepted (default 256)"
+              << std::endl
+              << std::endl
+              << "  --load SOCKET          load generator: report p50/p99 latency and requests per second" << std::endl
+              << "  --clients N            concurrent connections (default 8)" << std::endl
+              << "  --requests N           requests per connection (default 10000)" << std::endl
+              << "  --size N               payload bytes (default 64)" << std::endl
+              << "  --memfd                pass payloads as memfd descriptors instead of inline" << std::endl;
+}
+
+};
+
+bool serve(const Server_options &options, std::string &error) {
+    sockaddr_un address;
+    if (!make_address(options.socket_path, address, error)) {
+        return false;
+    }
+
+    // оставшийся от прошлого запуска сокет удаляем, любой другой файл -- нет
+    struct stat info;
+    if (lstat(options.socket_path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(options.socket_path.c_str());
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, 128) != 0) {
+        error = strerror(errno);
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return false;
+    }
+
+    stop_requested = false;
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    {
+        Server server(options);
+        server.accept_loop(listen_fd);
+        server.print_summary();
+    }
+
+    close(listen_fd);
+    unlink(options.socket_path.c_str());
+    return true;
+}
+
+Client::~Client() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool Client::connect(const std::string &socket_path, std::string &error) {
+    sockaddr_un address;
+    if (!make_address(socket_path, address, error)) {
+        return false;
+    }
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || ::connect(fd_, (sockaddr *)&address, sizeof(address)) != 0) {
+        error = strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Client::request(Operation operation, size_t hash_bits, const uint8_t *key, size_t key_length,
+                     const uint8_t *expected, size_t expected_length, const uint8_t *payload,
+                     uint64_t payload_length, int payload_fd, Status &status, std::vector<uint8_t> &digest,
+                     std::string &error) {
+    if (key_length > UINT16_MAX || expected_length > UINT16_MAX) {
+        error = "key or expected digest is too long";
+        return false;
+    }
+
+    Request_header request = {};
+    request.magic = request_magic;
+    request.operation = operation;
+    request.flags = payload_fd >= 0 ? payload_memfd : 0;
+    request.hash_bits = (uint16_t)hash_bits;
+    request.key_length = (uint16_t)key_length;
+    request.expected_length = (uint16_t)expected_length;
+    request.payload_length = payload_length;
+    request.request_id = next_id_++;
+
+    iovec vectors[4] = {{&request, sizeof(request)},
+                        {(void *)key, key_length},
+                        {(void *)expected, expected_length},
+                        {(void *)payload, payload_fd >= 0 ? 0 : (size_t)payload_length}};
+    if (!send_vectors(fd_, vectors, 4, payload_fd)) {
+        error = strerror(errno);
+        return false;
+    }
+
+    // ответ не длиннее заголовка и 64 байт дайджеста, а запрос в полёте один -- лишнего не прочитаем
+    uint8_t buffer[sizeof(Response_header) + max_digest_size];
+    Response_header response;
+    size_t received = 0;
+    while (received < sizeof(response) || received < sizeof(response) + response.digest_length) {
+        auto result = recv(fd_, buffer + received, sizeof(buffer) - received, 0);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            error = result == 0 ? "connection closed by daemon" : strerror(errno);
+            return false;
+        }
+        received += (size_t)result;
+        if (received >= sizeof(response)) {
+            memcpy(&response, buffer, sizeof(response));
+            if (response.magic != response_magic || response.request_id != request.request_id ||
+                response.digest_length > max_digest_size) {
+                error = "bad response";
+                return false;
+            }
+        }
+    }
+    digest.assign(buffer + sizeof(response), buffer + sizeof(response) + response.digest_length);
+    status = (Status)response.status;
+    return true;
+}
+
+bool run_load(const Load_options &options, std::string &error) {
+    std::vector<uint8_t> payload(options.payload_size);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = (uint8_t)(i * 131 + 7);
+    }
+    uint8_t key[32];
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)i;
+    }
+    const bool keyed = options.operation == operation_hmac;
+
+    // эталон считается локально и сверяется с ответом демона
+    std::vector<uint8_t> expected(options.hash_bits / 8);
+    if (keyed) {
+        if (options.hash_bits == 256) {
+            Hmac_256::mac(key, sizeof(key), payload.data(), payload.size(), expected.data());
+        } else {
+            Hmac_512::mac(key, sizeof(key), payload.data(), payload.size(), expected.data());
+        }
+    } else if (options.hash_bits == 256) {
+        Streebog_256::hash(payload.data(), payload.size(), expected.data());
+    } else {
+        Streebog_512::hash(payload.data(), payload.size(), expected.data());
+    }
+
+    std::vector<std::vector<double> > latencies(options.clients);
+    std::vector<std::string> errors(options.clients);
+    auto time_begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < options.clients; c++) {
+        threads.emplace_back([&, c] {
+            Client client;
+            if (!client.connect(options.socket_path, errors[c])) {
+                return;
+            }
+            int payload_fd = -1;
+            if (options.memfd) {
+                payload_fd = memfd_create("stribog-load", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+                if (payload_fd < 0 || write(payload_fd, payload.data(), payload.size()) != (ssize_t)payload.size() ||
+                    fcntl(payload_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_WRITE) != 0) {
+                    errors[c] = "memfd: " + std::string(strerror(errno));
+                    return;
+                }
+            }
+
+            std::vector<uint8_t> digest;
+            latencies[c].reserve(options.requests);
+            for (size_t i = 0; i < options.requests; i++) {
+                Status status;
+                auto request_begin = std::chrono::steady_clock::now();
+                bool ok = client.request(options.operation, options.hash_bits, keyed ? key : nullptr,
+                                         keyed ? sizeof(key) : 0,
+                                         options.operation == operation_verify ? expected.data() : nullptr,
+                                         options.operation == operation_verify ? expected.size() : 0,
+                                         payload.data(), payload.size(), payload_fd, status, digest, errors[c]);
+                std::chrono::duration<double> latency = std::chrono::steady_clock::now() - request_begin;
+                if (!ok) {
+                    break;
+                }
+                if (status != status_ok || (options.operation != operation_verify && digest != expected)) {
+                    errors[c] = "unexpected response (status " + std::to_string(status) + ")";
+                    break;
+                }
+                latencies[c].push_back(latency.count());
+            }
+            if (payload_fd >= 0) {
+                close(payload_fd);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - time_begin;
+
+    for (auto &message : errors) {
+        if (!message.empty()) {
+            error = message;
+            return false;
+        }
+    }
+
+    std::vector<double> all;
+    for (auto &client : latencies) {
+        all.insert(all.end(), client.begin(), client.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double p) {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, (size_t)(p * (double)all.size()))] * 1e6;
+    };
+    std::cout << all.size() << " requests from " << options.clients << " clients in " << seconds.count() << " s: "
+              << (double)all.size() / seconds.count() << " req/s" << std::endl
+              << "latency: p50 " << percentile(0.50) << " us, p99 " << percentile(0.99) << " us, max "
+              << percentile(1.0) << " us" << std::endl;
+    return true;
+}
+
+int run(int argc, char **argv) {
+    Server_options server;
+    Load_options load;
+    bool daemon_mode = strcmp(argv[1], "--daemon") == 0;
+    if (argc < 3 || argv[2][0] == '-') {
+        print_usage(argv[0]);
+        return argc < 3 ? 2 : 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--memfd") {
+            load.memfd = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << argv[0] << ": unknown option or missing value " << arg << std::endl;
+            print_usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        auto number = strtoul(value.c_str(), nullptr, 10);
+        if (arg == "--daemon" || arg == "--load") {
+            server.socket_path = load.socket_path = value;
+        } else if (arg == "--batch-limit" && number > 0) {
+            server.batch_limit = number;
+        } else if (arg == "--batch-window") {
+            server.batch_window = std::chrono::microseconds(number);
+        } else if (arg == "--batch-max-payload") {
+            server.batch_max_payload = number;
+        } else if (arg == "--max-connections" && number > 0) {
+            server.max_connections = number;
+        } else if (arg == "--clients" && number > 0) {
+            load.clients = number;
+        } else if (arg == "--requests") {
+            load.requests = number;
+        } else if (arg == "--size") {
+            load.payload_size = number;
+        } else if (arg == "-a" && (number == 256 || number == 512)) {
+            load.hash_bits = number;
+        } else if (arg == "--op" && (value == "hash" || value == "hmac" || value == "verify")) {
+            load.operation = value == "hash" ? operation_hash : value == "hmac" ? operation_hmac : operation_verify;
+        } else {
+            std::cerr << argv[0] << ": bad option " << arg << " " << value << std::endl;
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::string error;
+    if (daemon_mode ? !serve(server, error) : !run_load(load, error)) {
+        std::cerr << argv[0] << ": " << server.socket_path << ": " << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Локальный демон хеширования на Unix-сокете: таблицы, ядра и потоки загружаются один раз,
+ * а процессы на хосте отправляют запросы hash / HMAC / verify по компактному двоичному протоколу.
+ *
+ * Каждый запрос -- заголовок Request_header, затем key_length байт ключа HMAC, expected_length байт
+ * ожидаемого дайджеста (для verify) и payload_length байт данных. С флагом payload_memfd данные
+ * не передаются в сокете: вместе с заголовком приходит дескриптор memfd (SCM_RIGHTS), демон
+ * отображает его в память и хеширует без копирования. memfd должен быть запечатан
+ * F_SEAL_SHRINK | F_SEAL_WRITE (создаётся с MFD_ALLOW_SEALING), иначе ответ -- status_bad_request. Ответ -- Response_header и digest_length байт.
+ * Все числа в little-endian; запросы одного соединения обрабатываются по порядку.
+ *
+ * Небольшие запросы hash от разных соединений собираются в пакеты и хешируются многобуферным
+ * движком (multibuffer::hash_many), все линии вектора заняты разными клиентами.
+ */
+namespace hash_daemon {
+
+const uint32_t request_magic = 0x31444253;     // "SBD1"
+const uint32_t response_magic = 0x31524253;    // "SBR1"
+
+enum Operation : uint8_t {
+    operation_hash = 1,
+    operation_hmac = 2,
+    operation_verify = 3       // с ключом -- проверка HMAC, без ключа -- проверка хеша
+};
+
+enum Flags : uint8_t {
+    payload_memfd = 1
+};
+
+enum Status : uint8_t {
+    status_ok = 0,
+    status_mismatch = 1,
+    status_bad_request = 2,
+    status_error = 3
+};
+
+#pragma pack(push, 1)
+
+struct Request_header {
+    uint32_t magic;
+    uint8_t operation;
+    uint8_t flags;
+    uint16_t hash_bits;
+    uint16_t key_length;
+    uint16_t expected_length;
+    uint32_t reserved;
+    uint64_t payload_length;
+    uint64_t request_id;
+};
+
+struct Response_header {
+    uint32_t magic;
+    uint8_t status;
+    uint8_t digest_length;
+    uint16_t reserved;
+    uint64_t request_id;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(Request_header) == 32, "wire format");
+static_assert(sizeof(Response_header) == 16, "wire format");
+
+/**
+ * Данные длиннее этого передаются только через memfd.
+ */
+const uint64_t max_inline_payload = 64 << 20;
+
+struct Server_options {
+    std::string socket_path;
+    size_t batch_limit = 64;                                // запросов в одном пакете
+    std::chrono::microseconds batch_window{0};              // ожидание попутчиков; 0 -- только уже ждущие
+    size_t batch_max_payload = 4096;                        // больше -- хешируется сразу, без пакета
+    size_t max_connections = 256;                           // по потоку на соединение; остальные ждут accept
+};
+
+/**
+ * Работает до SIGINT / SIGTERM. При ошибке запуска возвращает false и описание в error.
+ */
+bool serve(const Server_options &options, std::string &error);
+
+/**
+ * Синхронный клиент: один запрос -- один ответ.
+ */
+class Client {
+public:
+    Client() = default;
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    ~Client();
+
+    bool connect(const std::string &socket_path, std::string &error);
+
+    /**
+     * payload_fd >= 0 -- данные в запечатанном memfd (payload не используется, payload_length -- его размер).
+     * digest получает digest_length байт ответа.
+     */
+    bool request(Operation operation, size_t hash_bits, const uint8_t *key, size_t key_length,
+                 const uint8_t *expected, size_t expected_length, const uint8_t *payload, uint64_t payload_length,
+                 int payload_fd, Status &status, std::vector<uint8_t> &digest, std::string &error);
+
+private:
+    int fd_ = -1;
+    uint64_t next_id_ = 1;
+};
+
+struct Load_options {
+    std::string socket_path;
+    size_t clients = 8;
+    size_t requests = 10000;        // на клиента
+    size_t payload_size = 64;
+    size_t hash_bits = 256;
+    Operation operation = operation_hash;
+    bool memfd = false;
+};
+
+/**
+ * Генератор нагрузки: clients соединений отправляют запросы подряд, затем печатаются
+ * p50 / p99 / max задержки и запросы в секунду. false при ошибке соединения или неверном ответе.
+ */
+bool run_load(const Load_options &options, std::string &error);
+
+/**
+ * Разбор командной строки для --daemon SOCKET и --load SOCKET.
+ */
+int run(int argc, char **argv);
+
+};
@@ -0,0 +1,186 @@
+#include "hex.h"
+
+#include <cstring>
+#include <immintrin.h>
+
+namespace hex {
+
+namespace {
+
+constexpr char digits[] = "0123456789abcdef";
+
+struct Decode_table {
+    uint8_t values[256];
+
+    constexpr Decode_table() : values() {
+        for (int i = 0; i < 256; i++) {
+            values[i] = 0xff;
+        }
+        for (int i = 0; i < 10; i++) {
+            values['0' + i] = (uint8_t)i;
+        }
+        for (int i = 0; i < 6; i++) {
+            values['a' + i] = (uint8_t)(10 + i);
+            values['A' + i] = (uint8_t)(10 + i);
+        }
+    }
+};
+
+constexpr Decode_table decode_table;
+
+void encode_scalar(const uint8_t *data, size_t length, char *out) {
+    for (size_t i = 0; i < length; i++) {
+        out[2 * i] = digits[data[i] >> 4];
+        out[2 * i + 1] = digits[data[i] & 0xf];
+    }
+}
+
+bool decode_scalar(const char *text, size_t length, uint8_t *out) {
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < length; i++) {
+        auto high = decode_table.values[(uint8_t)text[2 * i]];
+        auto low = decode_table.values[(uint8_t)text[2 * i + 1]];
+        invalid |= (high | low) & 0xf0;
+        out[i] = (uint8_t)(high << 4 | low);
+    }
+    return invalid == 0;
+}
+
+bool scalar_supported() {
+    return true;
+}
+
+#pragma GCC push_options
+#pragma GCC target("ssse3")
+
+/**
+ * Значения 16 символов: цифры и буквы a-f / A-F; valid -- маска допустимых символов.
+ */
+inline __m128i nibbles_ssse3(__m128i chars, __m128i &valid) {
+    auto digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    auto is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    auto letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    auto is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    valid = _mm_or_si128(is_digit, is_letter);
+    return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                        _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+void encode_ssse3(const uint8_t *data, size_t length, char *out) {
+    const auto lookup = _mm_loadu_si128((const __m128i *)digits);
+    const auto mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        auto bytes = _mm_loadu_si128((const __m128i *)(data + i));
+        auto high = _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+        auto low = _mm_shuffle_epi8(lookup, _mm_and_si128(bytes, mask));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+    encode_scalar(data + i, length - i, out + 2 * i);
+}
+
+bool decode_ssse3(const char *text, size_t length, uint8_t *out) {
+    // старший полубайт умножается на 16, младший на 1 и складывается в 16-битное слово
+    const auto weights = _mm_set1_epi16(0x0110);
+    auto valid = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i valid_first, valid_second;
+        auto first = nibbles_ssse3(_mm_loadu_si128((const __m128i *)(text + 2 * i)), valid_first);
+        auto second = nibbles_ssse3(_mm_loadu_si128((const __m128i *)(text + 2 * i + 16)), valid_second);
+        valid = _mm_and_si128(valid, _mm_and_si128(valid_first, valid_second));
+        auto bytes = _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights));
+        _mm_storeu_si128((__m128i *)(out + i), bytes);
+    }
+    return _mm_movemask_epi8(valid) == 0xffff && decode_scalar(text + 2 * i, length - i, out + i);
+}
+
+bool ssse3_supported() {
+    return __builtin_cpu_supports("ssse3");
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+inline __m256i nibbles_avx2(__m256i chars, __m256i &valid) {
+    auto digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    auto is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    auto letter = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    auto is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+    valid = _mm256_or_si256(is_digit, is_letter);
+    return _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                           _mm256_and_si256(is_letter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+void encode_avx2(const uint8_t *data, size_t length, char *out) {
+    const auto lookup = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)digits));
+    const auto mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        auto bytes = _mm256_loadu_si256((const __m256i *)(data + i));
+        auto high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+        auto low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(bytes, mask));
+        // unpack работает внутри 128-битных половин, permute2x128 восстанавливает порядок
+        auto first = _mm256_unpacklo_epi8(high, low);
+        auto second = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256((__m256i *)(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    encode_ssse3(data + i, length - i, out + 2 * i);
+}
+
+bool decode_avx2(const char *text, size_t length, uint8_t *out) {
+    const auto weights = _mm256_set1_epi16(0x0110);
+    auto valid = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i valid_first, valid_second;
+        auto first = nibbles_avx2(_mm256_loadu_si256((const __m256i *)(text + 2 * i)), valid_first);
+        auto second = nibbles_avx2(_mm256_loadu_si256((const __m256i *)(text + 2 * i + 32)), valid_second);
+        valid = _mm256_and_si256(valid, _mm256_and_si256(valid_first, valid_second));
+        auto packed = _mm256_packus_epi16(_mm256_maddubs_epi16(first, weights),
+                                          _mm256_maddubs_epi16(second, weights));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+    return _mm256_movemask_epi8(valid) == -1 && decode_ssse3(text + 2 * i, length - i, out + i);
+}
+
+bool avx2_supported() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#pragma GCC pop_options
+
+const Codec codec_list[] = {
+        {"avx2",   encode_avx2,   decode_avx2,   avx2_supported},
+        {"ssse3",  encode_ssse3,  decode_ssse3,  ssse3_supported},
+        {"scalar", encode_scalar, decode_scalar, scalar_supported},
+};
+
+const Codec &select_codec() {
+    __builtin_cpu_init();
+    for (const auto &codec : codec_list) {
+        if (codec.supported()) {
+            return codec;
+        }
+    }
+    return codec_list[2];
+}
+
+};
+
+const Codec *all(size_t &count) {
+    __builtin_cpu_init();
+    count = sizeof(codec_list) / sizeof(codec_list[0]);
+    return codec_list;
+}
+
+const Codec &active() {
+    static const Codec &codec = select_codec();
+    return codec;
+}
+
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Шестнадцатеричная запись байтов для массового вывода и проверки дайджестов.
+ *
+ * Кодирование -- строчными буквами, два символа на байт в порядке хранения; декодирование
+ * принимает обе раскладки и проверяет каждый символ. Реализация выбирается при первом вызове
+ * по cpuid (avx2, ssse3, scalar), результаты всех реализаций одинаковы. Строки не завершаются
+ * нулём: вызывающий передаёт буфер нужного размера.
+ */
+namespace hex {
+
+struct Codec {
+    const char *name;
+    void (*encode)(const uint8_t *data, size_t length, char *out);
+    bool (*decode)(const char *text, size_t length, uint8_t *out);
+    bool (*supported)();
+};
+
+/**
+ * Все реализации в порядке убывания предпочтения.
+ */
+const Codec *all(size_t &count);
+
+const Codec &active();
+
+/**
+ * Записывает 2 * length символов в out.
+ */
+inline void encode(const uint8_t *data, size_t length, char *out) {
+    static const auto function = active().encode;
+    function(data, length, out);
+}
+
+/**
+ * Разбирает 2 * length символов text в length байт out; false, если встретился не hex-символ
+ * (out тогда может быть заполнен частично).
+ */
+inline bool decode(const char *text, size_t length, uint8_t *out) {
+    static const auto function = active().decode;
+    return function(text, length, out);
+}
+
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "streebog.h"
+
+/**
+ * HMAC_GOSTR3411_2012_256/512 (Р 50.1.113-2016, RFC 7836).
+ *
+ * Ключ раскрывается до 64-байтного блока один раз, и контекст хранит состояния Streebog после
+ * блоков K ^ ipad и K ^ opad. Каждое следующее значение имитовставки начинается с копии этих
+ * промежуточных состояний, без повторного сжатия блоков ключа и без выделения памяти.
+ */
+template<size_t hash_bits>
+class Hmac {
+public:
+    using Hash = Streebog<hash_bits>;
+    using digest_t = typename Hash::digest_t;
+
+    static constexpr size_t block_size = Hash::block_size;
+    static constexpr size_t digest_size = Hash::digest_size;
+
+    Hmac() = default;
+
+    Hmac(const uint8_t *key, size_t key_length) {
+        set_key(key, key_length);
+    }
+
+    /**
+     * Ключ длиннее блока предварительно хешируется, короче -- дополняется нулями.
+     */
+    void set_key(const uint8_t *key, size_t key_length) {
+        uint8_t block[block_size] = {};
+        if (key_length > block_size) {
+            Hash::hash(key, key_length, block);
+        } else {
+            memcpy(block, key, key_length);
+        }
+
+        for (auto &byte : block) {
+            byte ^= 0x36;
+        }
+        inner_.init();
+        inner_.update(block, block_size);
+
+        for (auto &byte : block) {
+            byte ^= 0x36 ^ 0x5c;
+        }
+        outer_.init();
+        outer_.update(block, block_size);
+
+        wipe(block, block_size);
+        init();
+    }
+
+    void init() {
+        context_ = inner_;
+    }
+
+    void update(const uint8_t *data, size_t length) {
+        context_.update(data, length);
+    }
+
+    void final(uint8_t *out) {
+        uint8_t inner_digest[digest_size];
+        context_.final(inner_digest);
+        auto outer = outer_;
+        outer.update(inner_digest, digest_size);
+        outer.final(out);
+        init();
+    }
+
+    digest_t final() {
+        digest_t result;
+        final(result.data());
+        return result;
+    }
+
+    /**
+     * Имитовставка одного сообщения на уже установленном ключе; состояние контекста не меняется.
+     */
+    void mac(const uint8_t *data, size_t length, uint8_t *out) const {
+        uint8_t inner_digest[digest_size];
+        auto inner = inner_;
+        inner.update(data, length);
+        inner.final(inner_digest);
+        auto outer = outer_;
+        outer.update(inner_digest, digest_size);
+        outer.final(out);
+    }
+
+    static void mac(const uint8_t *key, size_t key_length, const uint8_t *data, size_t length, uint8_t *out) {
+        Hmac(key, key_length).mac(data, length, out);
+    }
+
+private:
+    static void wipe(uint8_t *data, size_t length) {
+        volatile uint8_t *bytes = data;
+        for (size_t i = 0; i < length; i++) {
+            bytes[i] = 0;
+        }
+    }
+
+    Hash inner_;
+    Hash outer_;
+    Hash context_;
+};
+
+using Hmac_256 = Hmac<256>;
+using Hmac_512 = Hmac<512>;
+
+/**
+ * PBKDF2 (Р 50.1.111-2016) с HMAC_GOSTR3411_2012_<hash_bits> в роли PRF; стандарт использует 512.
+ *
+ * Ключ пароля устанавливается один раз, все iterations вычислений U_j идут от сохранённых
+ * промежуточных состояний и используют только буферы на стеке.
+ */
+template<size_t hash_bits>
+void pbkdf2(const uint8_t *password, size_t password_length, const uint8_t *salt, size_t salt_length,
+            uint64_t iterations, uint8_t *out, size_t out_length) {
+    constexpr size_t digest_size = Hmac<hash_bits>::digest_size;
+
+    Hmac<hash_bits> prf(password, password_length);
+    uint8_t u[digest_size];
+    uint8_t t[digest_size];
+    for (uint32_t block = 1; out_length > 0; block++) {
+        const uint8_t index[4] = {(uint8_t)(block >> 24), (uint8_t)(block >> 16), (uint8_t)(block >> 8),
+                                  (uint8_t)block};
+        prf.init();
+        prf.update(salt, salt_length);
+        prf.update(index, sizeof(index));
+        prf.final(u);
+        memcpy(t, u, digest_size);
+
+        for (uint64_t j = 1; j < iterations; j++) {
+            prf.mac(u, digest_size, u);
+            for (size_t i = 0; i < digest_size; i++) {
+                t[i] ^= u[i];
+            }
+        }
+
+        auto length = std::min(out_length, digest_size);
+        memcpy(out, t, length);
+        out += length;
+        out_length -= length;
+    }
+}
+
+/**
+ * KDF_GOSTR3411_2012_256 (Р 50.1.113-2016, RFC 7836, 4.5):
+ * HMAC_GOSTR3411_2012_256(K, 0x01 || label || 0x00 || seed || 0x01 || 0x00), 32 байта в out.
+ */
+inline void kdf_gostr3411_2012_256(const uint8_t *key, size_t key_length, const uint8_t *label, size_t label_length,
+                                   const uint8_t *seed, size_t seed_length, uint8_t *out) {
+    const uint8_t counter[1] = {0x01};
+    const uint8_t separator[1] = {0x00};
+    const uint8_t length[2] = {0x01, 0x00};
+
+    Hmac_256 hmac(key, key_length);
+    hmac.update(counter, sizeof(counter));
+    hmac.update(label, label_length);
+    hmac.update(separator, sizeof(separator));
+    hmac.update(seed, seed_length);
+    hmac.update(length, sizeof(length));
+    hmac.final(out);
+}
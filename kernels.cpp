@@ -0,0 +1,187 @@
+#include "kernels.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <immintrin.h>
+
+#include "stats.h"
+
+namespace kernels {
+
+namespace {
+
+using compression::state_t;
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+/**
+ * AVX-512: всё состояние в одном zmm-регистре, 8 gather по 8 слов на одно LPS.
+ */
+inline __m512i lps_avx512(__m512i x) {
+    const auto &table = compression::lps_table;
+
+    alignas(64) uint64_t limbs[8];
+    _mm512_store_si512(limbs, x);
+
+    __m512i result = _mm512_setzero_si512();
+    for (int j = 0; j < 8; j++) {
+        // восемь байт слова j расширяются до восьми 64-битных индексов
+        auto index = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)(limbs + j)));
+        result = _mm512_xor_si512(result, _mm512_i64gather_epi64(index, table[j].data(), 8));
+    }
+    return result;
+}
+
+state_t g_avx512(const state_t &h_value, const state_t &m_value, const state_t &N_value) {
+    const auto &c_values = compression::iteration_constants;
+
+    auto h = _mm512_loadu_si512(h_value.data());
+    auto m = _mm512_loadu_si512(m_value.data());
+    auto key = lps_avx512(_mm512_xor_si512(h, _mm512_loadu_si512(N_value.data())));
+
+#ifdef STRIBOG_STATS
+    // как в compression::e_function: расписание отдельно, чтобы --stats делил время и здесь
+    __m512i keys[12];
+    auto value = _mm512_xor_si512(key, m);
+    {
+        STRIBOG_STATS_TIME(key_schedule);
+        for (int round = 0; round < 12; round++) {
+            key = lps_avx512(_mm512_xor_si512(key, _mm512_loadu_si512(c_values[round].data())));
+            keys[round] = key;
+        }
+    }
+    {
+        STRIBOG_STATS_TIME(rounds);
+        for (int round = 0; round < 12; round++) {
+            value = _mm512_xor_si512(lps_avx512(value), keys[round]);
+        }
+    }
+#else
+    auto value = _mm512_xor_si512(key, m);
+    for (int round = 0; round < 12; round++) {
+        value = lps_avx512(value);
+        key = lps_avx512(_mm512_xor_si512(key, _mm512_loadu_si512(c_values[round].data())));
+        value = _mm512_xor_si512(value, key);
+    }
+#endif
+
+    state_t result;
+    _mm512_storeu_si512(result.data(), _mm512_xor_si512(value, _mm512_xor_si512(h, m)));
+    return result;
+}
+
+/**
+ * Две цепочки в чередовании: четыре независимые LPS за раунд, gather одной цепочки
+ * ждут данных, пока считается другая.
+ */
+void g_pair_avx512(state_t &first_value, state_t &second_value, const state_t &m_value, const state_t &N_value) {
+    const auto &c_values = compression::iteration_constants;
+
+    auto first = _mm512_loadu_si512(first_value.data());
+    auto second = _mm512_loadu_si512(second_value.data());
+    auto m = _mm512_loadu_si512(m_value.data());
+    auto N = _mm512_loadu_si512(N_value.data());
+    auto key_first = lps_avx512(_mm512_xor_si512(first, N));
+    auto key_second = lps_avx512(_mm512_xor_si512(second, N));
+
+    auto value_first = _mm512_xor_si512(key_first, m);
+    auto value_second = _mm512_xor_si512(key_second, m);
+#ifdef STRIBOG_STATS
+    __m512i keys_first[12], keys_second[12];
+    {
+        STRIBOG_STATS_TIME(key_schedule);
+        for (int round = 0; round < 12; round++) {
+            auto c = _mm512_loadu_si512(c_values[round].data());
+            key_first = lps_avx512(_mm512_xor_si512(key_first, c));
+            key_second = lps_avx512(_mm512_xor_si512(key_second, c));
+            keys_first[round] = key_first;
+            keys_second[round] = key_second;
+        }
+    }
+    {
+        STRIBOG_STATS_TIME(rounds);
+        for (int round = 0; round < 12; round++) {
+            value_first = _mm512_xor_si512(lps_avx512(value_first), keys_first[round]);
+            value_second = _mm512_xor_si512(lps_avx512(value_second), keys_second[round]);
+        }
+    }
+#else
+    for (int round = 0; round < 12; round++) {
+        auto c = _mm512_loadu_si512(c_values[round].data());
+        value_first = lps_avx512(value_first);
+        value_second = lps_avx512(value_second);
+        key_first = lps_avx512(_mm512_xor_si512(key_first, c));
+        key_second = lps_avx512(_mm512_xor_si512(key_second, c));
+        value_first = _mm512_xor_si512(value_first, key_first);
+        value_second = _mm512_xor_si512(value_second, key_second);
+    }
+#endif
+
+    _mm512_storeu_si512(first_value.data(), _mm512_xor_si512(first, _mm512_xor_si512(value_first, m)));
+    _mm512_storeu_si512(second_value.data(), _mm512_xor_si512(second, _mm512_xor_si512(value_second, m)));
+}
+
+bool avx512_supported() {
+    return __builtin_cpu_supports("avx512f");
+}
+
+#pragma GCC pop_options
+
+bool scalar_supported() {
+    return true;
+}
+
+/**
+ * Порядок -- по измеренной скорости: gather на AVX-512 примерно равен скалярному табличному циклу.
+ * AVX2 (gather по 4 слова) и SSE4.1 (сборка пар слов через pinsrq) ему проигрывают, поэтому
+ * таких ядер нет.
+ */
+const Kernel kernel_list[] = {
+        {"avx512", g_avx512,                g_pair_avx512,       avx512_supported},
+        {"scalar", compression::g_function, compression::g_pair, scalar_supported},
+};
+
+const Kernel &select_kernel() {
+    __builtin_cpu_init();
+
+    const char *forced = getenv("STRIBOG_KERNEL");
+    if (forced != nullptr && *forced != '\0') {
+        if (auto kernel = find(forced)) {
+            return *kernel;
+        }
+        std::cerr << "STRIBOG_KERNEL=" << forced << " is unknown or not supported by this CPU, ignoring" << std::endl;
+    }
+
+    for (const auto &kernel : kernel_list) {
+        if (kernel.supported()) {
+            return kernel;
+        }
+    }
+    return kernel_list[1];
+}
+
+};
+
+const Kernel *all(size_t &count) {
+    count = sizeof(kernel_list) / sizeof(kernel_list[0]);
+    return kernel_list;
+}
+
+const Kernel *find(const char *name) {
+    __builtin_cpu_init();
+    for (const auto &kernel : kernel_list) {
+        if (strcmp(kernel.name, name) == 0) {
+            return kernel.supported() ? &kernel : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+const Kernel &active() {
+    static const Kernel &kernel = select_kernel();
+    return kernel;
+}
+
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+
+#include "compression.h"
+
+/**
+ * Выбор реализации функции сжатия g_N во время выполнения.
+ *
+ * При первом обращении по cpuid выбирается лучшее ядро, доступное на этой машине;
+ * переменная окружения STRIBOG_KERNEL (scalar, avx512) принудительно задаёт ядро.
+ * Все ядра дают побитово одинаковый результат.
+ */
+namespace kernels {
+
+using g_function_t = compression::state_t (*)(const compression::state_t &h,
+                                              const compression::state_t &m,
+                                              const compression::state_t &N);
+
+/**
+ * Две цепочки с общими m и N, результат записывается на место first и second.
+ */
+using g_pair_t = void (*)(compression::state_t &first, compression::state_t &second,
+                          const compression::state_t &m, const compression::state_t &N);
+
+struct Kernel {
+    const char *name;
+    g_function_t g_function;
+    g_pair_t g_pair;
+    bool (*supported)();
+};
+
+/**
+ * Все ядра, собранные в бинарник, в порядке убывания предпочтения.
+ */
+const Kernel *all(size_t &count);
+
+/**
+ * Ядро по имени или nullptr, если такого нет или процессор его не поддерживает.
+ */
+const Kernel *find(const char *name);
+
+const Kernel &active();
+
+inline compression::state_t g_function(const compression::state_t &h,
+                                       const compression::state_t &m,
+                                       const compression::state_t &N) {
+    static const g_function_t g = active().g_function;
+    return g(h, m, N);
+}
+
+inline void g_pair(compression::state_t &first, compression::state_t &second,
+                   const compression::state_t &m, const compression::state_t &N) {
+    static const g_pair_t g = active().g_pair;
+    g(first, second, m, N);
+}
+
+};
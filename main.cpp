@@ -1,321 +1,1342 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <array>
+#include <csignal>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
 
-#include "constants.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-using __uint512_t = std::array<__uint128_t, 4>;
+#include "stribog_hash.h"
+#include "streebog.h"
+#include "hmac.h"
+#include "multibuffer.h"
+#include "kernels.h"
+#include "sum_tool.h"
+#include "streebog_c.h"
+#include "hash_daemon.h"
+#include "chunker.h"
+#include "chunk_store.h"
+#include "drbg.h"
+#include "async_hash.h"
+#include "records.h"
+#include "hex.h"
+#include "digest_cache.h"
+#include "dir_hasher.h"
+#include "file_hash.h"
+#include "tree_mode.h"
 
-class Stribog_hash {
+void test_utils() {
+    const char *message_str = "00112233445566778899AABBCCDDEEFF\0";
+    auto value = utils::parse_hex<__uint128_t>(message_str);
+    utils::print_hex<__uint128_t>(value);
+};
 
-    __uint128_t linear_transformation(const __uint128_t &value128) const {
-        static const auto &transform_matrix = constants::linear_transformation::get_linear_matrix();
-        auto value1 = (uint64_t)(value128 >> 64);
-        auto value2 = (uint64_t)value128;
+void test_stribog() {
 
-        uint64_t result1 = 0;
-        uint64_t result2 = 0;
-        for (int i = 0; i < 64; i++) {
-            const auto& value = transform_matrix[i];
-            if (value1 & 1) {
-                result1 ^= value;
-            }
-            if (value2 & 1) {
-                result2 ^= value;
-            }
-            value1 >>= 1;
-            value2 >>= 1;
-        }
-        auto result = ((__uint128_t)(result1) << 64) | result2;
-        return result;
+    std::cout << std::endl << "test_stribog" << std::endl << std::endl;
+
+    Stribog_hash stribog({0, 0, 0, 0});
+    const char *message_str = "323130393837363534333231303938373635343332313039383736353433323130393837363534333231303938373635343332313039383736353433323130\0";
+
+    auto message_length = strlen(message_str);
+
+    std::vector<__uint128_t> message;
+    for (int i = 0; i < 4; i++) {
+        message.push_back(utils::parse_hex<__uint128_t>(message_str + 32 * i));
     }
 
-    __uint128_t pi_transformation(const __uint128_t &value) const {
-        static const auto &pi = constants::pi_transformation::pi;
+    for (int i = 0; i < 4; i++) {
+        utils::print_hex(message[i]);
+    }
 
-        __uint128_t result = 0;
-        __uint128_t mask = 0b11111111;
-        size_t offset = 0;
-        for (int i = 0; i < 16; i++) {
-            auto byte = (uint8_t) ((value & mask) >> offset);
-            result |= (__uint128_t) pi[byte] << offset;
-            mask <<= 8;
-            offset += 8;
-        }
+    std::cout << std::endl << std::endl;
+
+    auto hash = stribog.hash(message, message_length * 4);
+
+    for (const auto &value : hash) {
+        utils::print_hex(value);
+    }
+    const char *result_hash = "486f64c1917879417fef082b3381a4e211c324f074654c38823a7b76f830ad00fa1fbae42b1285c0352f227524bc9ab16254288dd6863dccd5b9f54a1ad0541b\0";
+    std::cout << result_hash << std::endl;
+
+    Stribog_hash reference({0, 0, 0, 0}, Stribog_hash::Backend::reference);
+    auto reference_hash = reference.hash(message, message_length * 4);
+    std::cout << "table backend matches reference: " << (reference_hash == hash ? "yes" : "NO") << std::endl;
+
+    const size_t SIZE = 1 * 1000;
+    auto time_begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < SIZE; i++) {
+        stribog.hash(hash, 512);
+    }
+    auto time_end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> seconds = time_end - time_begin;
+    std::cerr << "encode: " << 512 / 8.0 * SIZE / seconds.count() / (1024.0 * 1024.0) << " MiB/s"
+              << " (Stribog_bench for real measurements)" << std::endl;
+}
+
+void test_streaming() {
+
+    std::cout << std::endl << "test_streaming" << std::endl << std::endl;
+
+    // M2 из ГОСТ Р 34.11-2012, записанное как 576-битное число
+    const std::string message_str = "fbe2e5f0eee3c820fbeafaebef20fffbf0e1e0f0f520e0ed20e8ece0ebe5f0f2f120fff0eeec20f120faf2fee5e2202ce8f6f3ede220e8e6eee1e8f0f2d1202ce8f0f2e5e220e5d1";
+    const char *result_hash = "28fbc9bada033b1460642bdcddb90c3fb3e56c497ccd0f62b8a2ad4935e85f037613966de4ee00531ae60f3b5a47f8dae06915d5f2f194996fcabf2622e6881e";
+
+    std::vector<uint8_t> bytes;
+    for (size_t i = message_str.length(); i >= 2; i -= 2) {
+        bytes.push_back(utils::parse_hex<uint8_t>(message_str.substr(i - 2, 2)));
+    }
+
+    Streebog_512 context;
+    for (auto byte : bytes) {
+        context.update(&byte, 1);
+    }
+    auto digest = context.final();
+
+    std::string streaming_hash;
+    for (auto it = digest.rbegin(); it != digest.rend(); ++it) {
+        streaming_hash += utils::to_hex(*it);
+    }
+
+    std::vector<__uint128_t> message;
+    for (size_t i = 0; i < message_str.length(); i += 32) {
+        message.push_back(utils::parse_hex<__uint128_t>(message_str.substr(i, 32)));
+    }
+    Stribog_hash reference({0, 0, 0, 0}, Stribog_hash::Backend::reference);
+    std::string reference_hash;
+    for (auto value : reference.hash(message, message_str.length() * 4)) {
+        reference_hash += utils::to_hex(value);
+    }
+
+    std::cout << streaming_hash << std::endl;
+    std::cout << result_hash << std::endl;
+    std::cout << "streaming matches reference: " << (streaming_hash == reference_hash ? "yes" : "NO") << std::endl;
 
-        return result;
+    std::string hash_256;
+    for (auto byte : Streebog_256::hash(bytes.data(), bytes.size())) {
+        hash_256 = utils::to_hex(byte) + hash_256;
     }
+    std::cout << hash_256 << std::endl;
+    std::cout << "508f7e553c06501d749a66fc28c6cac0b005746d97537fa85d9e40904efed29d" << std::endl;
 
-    __uint512_t s_conversion(const __uint512_t &block) const {
-        __uint512_t result;
-        for (int i = 0; i < 4; i++) {
-            result[i] = pi_transformation(block[i]);
+    // многоблочные сообщения: при сложении N и Sigma возникают переносы между 128-битными словами
+    Stribog_hash table({0, 0, 0, 0});
+    std::vector<uint8_t> data(200);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t)(0xff - i * 3);
+    }
+    size_t mismatched = 0;
+    for (size_t length = 0; length <= data.size(); length++) {
+        std::string hex;
+        for (size_t i = length; i > 0; i--) {
+            hex += utils::to_hex(data[i - 1]);
+        }
+        std::vector<__uint128_t> blocks;
+        for (size_t i = 0; i < hex.length(); i += 32) {
+            blocks.push_back(utils::parse_hex<__uint128_t>(hex.substr(i, 32)));
+        }
+        std::string expected;
+        for (auto value : table.hash(blocks, length * 8)) {
+            expected += utils::to_hex(value);
         }
-        return result;
+        auto digest = Streebog_512::hash(data.data(), length);
+        std::string actual;
+        for (auto it = digest.rbegin(); it != digest.rend(); ++it) {
+            actual += utils::to_hex(*it);
+        }
+        mismatched += actual != expected ? 1 : 0;
     }
+    std::cout << "streaming matches Stribog_hash for lengths 0..200: " << (mismatched == 0 ? "yes" : "NO") << std::endl;
+}
 
-    __uint512_t p_conversion(const __uint512_t &block) const {
-        static const auto &tau = constants::tau_transformation::tau;
+void test_multibuffer() {
 
-        std::array<uint8_t, 64> bytes = {};
-        for (int i = 3; i >= 0; i--) {
-            auto value = block[i];
-            for (int j = 0; j < 16; j++) {
-                bytes[16 * i + (15 - j)] = ((uint8_t) value);
-                value >>= 8;
-            }
+    std::cout << std::endl << "test_multibuffer (" << multibuffer::lanes() << " lanes)" << std::endl << std::endl;
+
+    const size_t COUNT = 20000;
+    std::vector<std::vector<uint8_t> > storage(COUNT);
+    std::vector<const uint8_t *> messages(COUNT);
+    std::vector<size_t> lengths(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        storage[i].resize(i * 7919 % 200);
+        for (size_t j = 0; j < storage[i].size(); j++) {
+            storage[i][j] = (uint8_t)(i * 31 + j);
         }
+        messages[i] = storage[i].data();
+        lengths[i] = storage[i].size();
+    }
+
+    std::vector<uint8_t> batched(COUNT * Streebog_256::digest_size);
+    std::vector<uint8_t> serial(COUNT * Streebog_256::digest_size);
+
+    auto time_begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < COUNT; i++) {
+        Streebog_256::hash(messages[i], lengths[i], serial.data() + i * Streebog_256::digest_size);
+    }
+    auto time_middle = std::chrono::steady_clock::now();
+    multibuffer::hash_many(messages.data(), lengths.data(), COUNT, batched.data(), 256);
+    auto time_end = std::chrono::steady_clock::now();
+
+    auto serial_seconds = std::chrono::duration<double>(time_middle - time_begin).count();
+    auto batched_seconds = std::chrono::duration<double>(time_end - time_middle).count();
+
+    std::cout << "multibuffer matches streaming: " << (batched == serial ? "yes" : "NO") << std::endl;
+    std::cerr << "hash() loop: " << COUNT / serial_seconds << " messages/s" << std::endl;
+    std::cerr << "hash_many: " << COUNT / batched_seconds << " messages/s ("
+              << serial_seconds / batched_seconds << "x)" << std::endl;
+}
+
+void test_kernels() {
+
+    std::cout << std::endl << "test_kernels (active: " << kernels::active().name << ")" << std::endl << std::endl;
 
-        std::array<uint8_t, 64> replaced = {};
-        for (int i = 0; i < 64; i++) {
-            replaced[i] = bytes[tau[i]];
+    const char *message_str = "323130393837363534333231303938373635343332313039383736353433323130393837363534333231303938373635343332313039383736353433323130\0";
+    std::vector<__uint128_t> message;
+    for (int i = 0; i < 4; i++) {
+        message.push_back(utils::parse_hex<__uint128_t>(message_str + 32 * i));
+    }
+    Stribog_hash reference({0, 0, 0, 0}, Stribog_hash::Backend::reference);
+    auto reference_hash = reference.hash(message, 504);
+    auto expected = compression::from_uint512({reference_hash[0], reference_hash[1],
+                                               reference_hash[2], reference_hash[3]});
+
+    // M1 как байтовая строка, уже дополненная единичным байтом
+    compression::state_t m = {};
+    memcpy(m.data(), "012345678901234567890123456789012345678901234567890123456789012\x01", 64);
+    compression::state_t N = {504};
+    const compression::state_t zero = {};
+
+    size_t count;
+    auto list = kernels::all(count);
+    for (size_t k = 0; k < count; k++) {
+        const auto &kernel = list[k];
+        if (!kernel.supported()) {
+            std::cout << kernel.name << ": not supported" << std::endl;
+            continue;
         }
 
-        __uint512_t result;
-        for (int i = 3; i >= 0; i--) {
-            __uint128_t value = 0;
-            for (int j = 0; j < 16; j++) {
-                value <<= 8;
-                value |= replaced[j + (3 - i) * 16];
-            }
-            result[3 - i] = value;
+        auto h = kernel.g_function(zero, m, zero);
+        h = kernel.g_function(h, N, zero);
+        h = kernel.g_function(h, m, zero);
+
+        const size_t SIZE = 100 * 1000;
+        auto state = h;
+        auto time_begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < SIZE; i++) {
+            state = kernel.g_function(state, m, N);
         }
+        auto time_end = std::chrono::steady_clock::now();
+        auto seconds = std::chrono::duration<double>(time_end - time_begin).count();
 
-        return result;
+        std::cout << kernel.name << " matches reference: " << (h == expected ? "yes" : "NO") << std::endl;
+        std::cerr << kernel.name << ": " << 64.0 * SIZE / seconds / (1 << 20) << " MiB/s" << (state[0] == 0 ? " " : "") << std::endl;
     }
+}
 
-    __uint512_t l_conversion(const __uint512_t &block) const {
-        __uint512_t result;
-        for (int i = 0; i < 4; i++) {
-            result[i] = linear_transformation(block[i]);
-        }
-        return result;
+void test_checkpoint() {
+
+    std::cout << std::endl << "test_checkpoint" << std::endl << std::endl;
+
+    std::vector<uint8_t> message(1000);
+    for (size_t i = 0; i < message.size(); i++) {
+        message[i] = (uint8_t)(i * 7);
     }
+    auto expected = Streebog_512::hash(message.data(), message.size());
 
-    __uint512_t xor_conversion(const __uint512_t &block1, const __uint512_t &block2) const {
-        __uint512_t result;
-        for (auto i = 0; i < block1.size(); i++) {
-            result[i] = block1[i] ^ block2[i];
-        }
-        return result;
+    // прерванное хеширование: снимок после 333 байт, продолжение в новом контексте
+    Streebog_512 first;
+    first.update(message.data(), 333);
+    uint8_t checkpoint[Streebog_512::max_checkpoint_size];
+    auto size = first.save_checkpoint(checkpoint);
+
+    Streebog_512 resumed;
+    bool loaded = resumed.load_checkpoint(checkpoint, size);
+    auto offset = resumed.bytes_hashed();
+    resumed.update(message.data() + offset, message.size() - offset);
+    std::cout << "resumed from checkpoint (" << size << " bytes): " << (loaded && resumed.final() == expected ? "yes" : "NO") << std::endl;
+
+    checkpoint[10] ^= 1;
+    std::cout << "corrupted checkpoint rejected: " << (!resumed.load_checkpoint(checkpoint, size) ? "yes" : "NO") << std::endl;
+    Streebog_256 other;
+    checkpoint[10] ^= 1;
+    std::cout << "wrong digest size rejected: " << (!other.load_checkpoint(checkpoint, size) ? "yes" : "NO") << std::endl;
+
+    // общий префикс: копия контекста -- готовое промежуточное состояние
+    Streebog_512 prefix;
+    prefix.update(message.data(), 960);
+    auto with_suffix = prefix;
+    with_suffix.update(message.data() + 960, 40);
+    std::cout << "midstate reuse: " << (with_suffix.final() == expected ? "yes" : "NO") << std::endl;
+}
+
+void test_hmac() {
+
+    std::cout << std::endl << "test_hmac" << std::endl << std::endl;
+
+    // примеры из Р 50.1.113-2016 (RFC 7836, приложение A)
+    uint8_t key[32];
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)i;
+    }
+    const uint8_t data[16] = {0x01, 0x26, 0xbd, 0xb8, 0x78, 0x00, 0xaf, 0x21,
+                              0x43, 0x41, 0x45, 0x65, 0x63, 0x78, 0x01, 0x00};
+
+    uint8_t tag_256[32];
+    Hmac_256::mac(key, sizeof(key), data, sizeof(data), tag_256);
+    auto hmac_256 = utils::bytes_to_hex(tag_256, sizeof(tag_256));
+    std::cout << hmac_256 << std::endl;
+    std::cout << "a1aa5f7de402d7b3d323f2991c8d4534013137010a83754fd0af6d7cd4922ed9" << std::endl;
+
+    Hmac_512 keyed(key, sizeof(key));
+    keyed.update(data, 5);
+    keyed.update(data + 5, sizeof(data) - 5);
+    auto tag_512 = keyed.final();
+    std::cout << utils::bytes_to_hex(tag_512.data(), tag_512.size()) << std::endl;
+    std::cout << "a59bab22ecae19c65fbde6e5f4e9f5d8549d31f037f9df9b905500e171923a773d5f1530f2ed7e964cb2eedc29e9ad2f3afe93b2814f79f5000ffc0366c251e6" << std::endl;
+
+    uint8_t kdf[32];
+    kdf_gostr3411_2012_256(key, sizeof(key), data + 1, 4, data + 6, 8, kdf);
+    std::cout << "kdf_gostr3411_2012_256: " << (utils::bytes_to_hex(kdf, sizeof(kdf)) == hmac_256 ? "yes" : "NO") << std::endl;
+
+    // Р 50.1.111-2016, приложение: P = "password", S = "salt", c = 2, dkLen = 64
+    uint8_t derived[64];
+    pbkdf2<512>((const uint8_t *)"password", 8, (const uint8_t *)"salt", 4, 2, derived, sizeof(derived));
+    std::cout << utils::bytes_to_hex(derived, sizeof(derived)) << std::endl;
+    std::cout << "5a585bafdfbb6e8830d6d68aa3b43ac00d2e4aebce01c9b31c2caed56f0236d4d34b2b8fbd2c4e89d54d46f50e47d45bbac301571743119e8d3c42ba66d348de" << std::endl;
+}
+
+template<size_t hash_bits, size_t input_size>
+bool fixed_matches_streaming() {
+    std::array<uint8_t, input_size> input;
+    for (size_t i = 0; i < input_size; i++) {
+        input[i] = (uint8_t)(i * 37 + 11);
     }
+    return Streebog<hash_bits>::hash(input) == Streebog<hash_bits>::hash(input.data(), input_size);
+}
 
-    __uint512_t lps_function(const __uint512_t &block) const {
-        return l_conversion(p_conversion(s_conversion(block)));
+template<size_t hash_bits>
+void benchmark_chain() {
+    const size_t SIZE = 100 * 1000;
+    typename Streebog<hash_bits>::digest_t link = {};
+    auto time_begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SIZE; i++) {
+        link = Streebog<hash_bits>::hash(link);
+    }
+    auto time_middle = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < SIZE; i++) {
+        link = Streebog<hash_bits>::hash(link.data(), link.size());
     }
+    auto time_end = std::chrono::steady_clock::now();
 
-    __uint512_t e_function(const __uint512_t &h, const __uint512_t &m) const {
-        const auto &c_values = constants::iteration_constants::get_iteration_constants();
-        auto key = h;
-        auto value = xor_conversion(key, m);
+    std::chrono::duration<double> fixed_seconds = time_middle - time_begin;
+    std::chrono::duration<double> generic_seconds = time_end - time_middle;
+    std::cerr << hash_bits << "-bit chain: " << SIZE / fixed_seconds.count() << " links/s fixed, "
+              << SIZE / generic_seconds.count() << " links/s generic" << std::endl;
+}
 
-//        std::cout << "e_function" << std::endl;
-        //utils::print_hex_array(key, "key");
-        //utils::print_hex_array(c_values[0], "c_value[0]");
-        //utils::print_hex_array(value, "X[k1](m)");
+void test_fixed() {
+
+    std::cout << std::endl << "test_fixed" << std::endl << std::endl;
+
+    bool matches = fixed_matches_streaming<256, 0>() && fixed_matches_streaming<256, 1>() &&
+                   fixed_matches_streaming<256, 32>() && fixed_matches_streaming<256, 63>() &&
+                   fixed_matches_streaming<256, 64>() && fixed_matches_streaming<512, 0>() &&
+                   fixed_matches_streaming<512, 8>() && fixed_matches_streaming<512, 32>() &&
+                   fixed_matches_streaming<512, 64>();
+    std::cout << "fixed-size path matches streaming: " << (matches ? "yes" : "NO") << std::endl;
+
+    benchmark_chain<256>();
+    benchmark_chain<512>();
+}
 
-        for (int i = 1; i < 13; i++) {
-            //utils::print_hex_array(key, "key on iteration " + std::to_string(i));
-            //utils::print_hex_array(xor_conversion(key, c_values[i - 1]), "key^c[i-1] on iteration " + std::to_string(i));
-            //utils::print_hex_array(s_conversion(xor_conversion(key, c_values[i - 1])), "s(key^c[i-1]) on iteration " + std::to_string(i));
-            //utils::print_hex_array(p_conversion(s_conversion(xor_conversion(key, c_values[i - 1]))), "p(s(key^c[i-1])) on iteration " + std::to_string(i));
-            //utils::print_hex_array(l_conversion(p_conversion(s_conversion(xor_conversion(key, c_values[i - 1])))), "l(p(s(key^c[i-1]))) on iteration " + std::to_string(i));
-            key = lps_function(xor_conversion(key, c_values[i - 1]));
+void test_c_abi() {
 
-            //utils::print_hex_array(lps_function(value), "value after iteration " + std::to_string(i));
-            value = xor_conversion(key, lps_function(value));
+    std::cout << std::endl << "test_c_abi (backend: " << streebog_backend() << ")" << std::endl << std::endl;
+
+    const size_t COUNT = 300;
+    std::vector<std::vector<uint8_t> > storage(COUNT);
+    std::vector<const uint8_t *> messages(COUNT);
+    std::vector<size_t> lengths(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        storage[i].resize(i * 7919 % 20000);
+        for (size_t j = 0; j < storage[i].size(); j++) {
+            storage[i][j] = (uint8_t)(i + j * 3);
         }
-        //utils::print_hex_array(value, "value");
-        return value;
+        messages[i] = storage[i].data();
+        lengths[i] = storage[i].size();
     }
 
-    __uint512_t g_function(const __uint512_t &h, const __uint512_t &m, const __uint512_t &N) const {
-        //utils::print_hex_array(h, "h");
-        //utils::print_hex_array(N, "N");
-        //utils::print_hex_array(xor_conversion(h, N), "xor h, N");
-        //utils::print_hex_array(s_conversion(xor_conversion(h, N)), "S(H(h, N))");
+    std::vector<uint8_t> expected(COUNT * 64);
+    auto ctx = streebog_new(512);
+    for (size_t i = 0; i < COUNT; i++) {
+        streebog_update(ctx, messages[i], lengths[i] / 2);
+        streebog_update(ctx, messages[i] + lengths[i] / 2, lengths[i] - lengths[i] / 2);
+        streebog_final(ctx, expected.data() + i * 64);
+    }
+    streebog_free(ctx);
 
-        const auto &stage1 = xor_conversion(h, N);
-        const auto &stage2 = lps_function(stage1);
-        //utils::print_hex_array(stage2, "key");
+    std::vector<uint8_t> batched(COUNT * 64);
+    streebog_hash_many(messages.data(), lengths.data(), COUNT, batched.data());
+    std::cout << "streebog_hash_many matches streebog_update: " << (batched == expected ? "yes" : "NO") << std::endl;
 
-        const auto &stage3 = e_function(stage2, m);
-        const auto &stage4 = xor_conversion(stage3, h);
-        const auto &stage5 = xor_conversion(stage4, m);
-        return stage5;
+    std::vector<uint8_t> parallel(COUNT * 32);
+    streebog_hash_many_ex(256, messages.data(), lengths.data(), COUNT, parallel.data(), 4);
+    bool matches = true;
+    for (size_t i = 0; i < COUNT; i++) {
+        uint8_t digest[32];
+        streebog_hash(256, messages[i], lengths[i], digest);
+        matches = matches && memcmp(digest, parallel.data() + i * 32, 32) == 0;
     }
+    std::cout << "streebog_hash_many_ex on 4 threads matches streebog_hash: " << (matches ? "yes" : "NO") << std::endl;
+    std::cout << "invalid digest size rejected: "
+              << (streebog_new(384) == nullptr && streebog_hash(128, nullptr, 0, nullptr) == -1 &&
+                  streebog_hash_many_ex(384, messages.data(), lengths.data(), COUNT, parallel.data(), 4) == -1
+                  ? "yes" : "NO") << std::endl;
+}
+
+void test_chunker() {
+
+    std::cout << std::endl << "test_chunker" << std::endl << std::endl;
 
-    __uint512_t addition(const __uint512_t &block1, const __uint512_t &block2) const {
-        __uint512_t result = {0, 0, 0, 0};
-        for (int i = 3; i >= 0; i--) {
-            result[i] = block1[i] + block2[i];
-            // проверка на переполнение
-            if (result[i] < block1[i] && i > 0) {
-                result[i - 1] += 1;
+    std::vector<uint8_t> original(4 << 20);
+    std::mt19937_64 random(2012);
+    for (auto &byte : original) {
+        byte = (uint8_t)random();
+    }
+    auto edited = original;
+    edited.insert(edited.begin() + (1 << 20), 100, 0x5a);
+
+    chunker::Chunker chunker;
+    std::vector<chunker::Chunk> before, after;
+    chunker.split(original.data(), original.size(), 0, true, before);
+    chunker.split(edited.data(), edited.size(), 0, true, after);
+
+    // после вставки границы совпадают с исходными со сдвигом на 100 байт
+    size_t shifted = 0;
+    for (const auto &chunk : after) {
+        for (const auto &old : before) {
+            auto moved = old.offset >= (1 << 20) ? old.offset + 100 : old.offset;
+            if (moved == chunk.offset && old.length == chunk.length) {
+                shifted++;
+                break;
             }
         }
-        return result;
+    }
+    std::cout << "chunks: " << before.size() << ", unchanged after a 100-byte insert: " << shifted << std::endl;
+    std::cout << "boundaries stable after insert: " << (after.size() - shifted <= 3 ? "yes" : "NO") << std::endl;
+
+    char directory[] = "/tmp/stribog-chunks-XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::cout << "chunk store: NO (mkdtemp failed)" << std::endl;
+        return;
+    }
+    std::string root = directory;
+    auto write_file = [](const std::string &path, const std::vector<uint8_t> &data) {
+        std::ofstream(path, std::ios::binary).write((const char *)data.data(), (std::streamsize)data.size());
     };
+    write_file(root + "/original", original);
+    write_file(root + "/edited", edited);
 
-    std::vector<__uint128_t> right_shifting(const std::vector<__uint128_t> &message, size_t bits_length) const {
-        std::vector<__uint128_t> result;
-
-        /**
-         * xxxxxxxxxxx000000000
-         * < payload >< shift >
-         */
-        auto shift_size = 128 - bits_length % 128;
-        for (int i = (int) message.size() - 1; i >= 0; i--) {
-            __uint128_t cur_part = message[i];
-            if (i != (int) message.size() - 1) {
-                cur_part >>= shift_size;
-            }
-            __uint128_t prev_part = 0;
-            if (i > 0) {
-                prev_part = message[i - 1] & (~((-1) << shift_size));
+    chunk_store::Ingest_options options;
+    options.window_size = 1 << 20;      // несколько окон на файл
+    std::vector<std::string> errors;
+    chunk_store::Ingest_report first, second, repeat;
+    bool stored;
+    {
+        chunk_store::Chunk_store store;
+        std::string error;
+        stored = store.open(root + "/store", error) &&
+                 chunk_store::ingest(store, {root + "/original"}, options, first, errors);
+    }
+    {
+        chunk_store::Chunk_store store;
+        std::string error;
+        stored = stored && store.open(root + "/store", error) &&
+                 chunk_store::ingest(store, {root + "/edited"}, options, second, errors) &&
+                 chunk_store::ingest(store, {root + "/original", root + "/edited"}, options, repeat, errors);
+
+        // исходный файл собирается из хранилища по своим фрагментам
+        std::vector<uint8_t> restored, data;
+        for (const auto &chunk : before) {
+            uint8_t digest[32];
+            Streebog_256::hash(original.data() + chunk.offset, chunk.length, digest);
+            stored = stored && store.get(digest, data, error);
+            restored.insert(restored.end(), data.begin(), data.end());
+        }
+        std::cout << "original restored from the store: " << (stored && restored == original ? "yes" : "NO")
+                  << std::endl;
+    }
+    std::cout << "first ingest stores everything: "
+              << (stored && errors.empty() && first.new_bytes == original.size() && first.chunks == before.size()
+                  ? "yes" : "NO") << std::endl;
+    std::cout << "re-ingest of an edited file stores " << second.new_chunks << " of " << second.chunks
+              << " chunks: " << (second.new_chunks <= 3 && second.chunks == after.size() ? "yes" : "NO") << std::endl;
+    std::cout << "repeated ingest stores nothing: " << (repeat.new_chunks == 0 && repeat.files == 2 ? "yes" : "NO")
+              << std::endl;
+
+    for (auto name : {"/original", "/edited", "/store/index", "/store/chunks.pack"}) {
+        unlink((root + name).c_str());
+    }
+    rmdir((root + "/store").c_str());
+    rmdir(directory);
+}
+
+void test_drbg() {
+
+    std::cout << std::endl << "test_drbg" << std::endl << std::endl;
+
+    uint8_t entropy[48], nonce[16];
+    for (size_t i = 0; i < sizeof(entropy); i++) {
+        entropy[i] = (uint8_t)i;
+    }
+    memset(nonce, 0x20, sizeof(nonce));
+
+    drbg::Hash_drbg first, second;
+    first.instantiate(entropy, sizeof(entropy), nonce, sizeof(nonce));
+    second.instantiate(entropy, sizeof(entropy), nonce, sizeof(nonce));
+    std::vector<uint8_t> bulk(drbg::Hash_drbg::max_request), piece(100);
+    first.generate(bulk.data(), bulk.size());
+    second.generate(piece.data(), piece.size());
+    std::cout << "same seed, same output (partial block matches bulk request): "
+              << (memcmp(bulk.data(), piece.data(), piece.size()) == 0 ? "yes" : "NO") << std::endl;
+
+    first.generate(bulk.data(), bulk.size());
+    second.generate(piece.data(), piece.size());
+    std::cout << "identical instances stay in step across requests: "
+              << (memcmp(bulk.data(), piece.data(), piece.size()) == 0 ? "yes" : "NO") << std::endl;
+
+    const uint8_t additional[] = {1, 2, 3};
+    first.generate(bulk.data(), 64, additional, sizeof(additional));
+    second.generate(piece.data(), 64);
+    std::cout << "additional input changes output: " << (memcmp(bulk.data(), piece.data(), 64) != 0 ? "yes" : "NO")
+              << std::endl;
+
+    drbg::Hash_drbg limited;
+    limited.instantiate(entropy, sizeof(entropy), nonce, sizeof(nonce));
+    limited.set_reseed_interval(2);
+    bool ok = limited.generate(piece.data(), 32) && limited.generate(piece.data(), 32) &&
+              !limited.generate(piece.data(), 32) && limited.needs_reseed();
+    ok = ok && limited.reseed(entropy, sizeof(entropy)) && limited.reseed_counter() == 1 &&
+         limited.generate(piece.data(), 32);
+    std::cout << "reseed required after the interval: " << (ok ? "yes" : "NO") << std::endl;
+    std::cout << "short entropy rejected: " << (!limited.instantiate(entropy, 16, nonce, sizeof(nonce)) ? "yes" : "NO")
+              << std::endl;
+
+    std::vector<uint8_t> a(64), b(64);
+    std::string error_a, error_b;
+    bool generated_a = false, generated_b = false;
+    std::thread other([&] { generated_a = drbg::random_bytes(a.data(), a.size(), error_a); });
+    generated_b = drbg::random_bytes(b.data(), b.size(), error_b);
+    other.join();
+    std::cout << "per-thread generators differ: " << (generated_a && generated_b && a != b ? "yes" : "NO")
+              << std::endl;
+
+    // потомок после fork не должен повторять вывод родителя
+    int pipe_fds[2];
+    bool forked = pipe(pipe_fds) == 0;
+    pid_t child = forked ? fork() : -1;
+    if (child == 0) {
+        std::string error;
+        bool generated = drbg::random_bytes(a.data(), a.size(), error);
+        _exit(generated && write(pipe_fds[1], a.data(), a.size()) == (ssize_t)a.size() ? 0 : 1);
+    }
+    bool differ = false;
+    if (child > 0) {
+        close(pipe_fds[1]);
+        generated_b = drbg::random_bytes(b.data(), b.size(), error_b);
+        differ = generated_b && read(pipe_fds[0], a.data(), a.size()) == (ssize_t)a.size() && a != b;
+        int status;
+        differ = waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 && differ;
+        close(pipe_fds[0]);
+    }
+    std::cout << "child after fork does not repeat the parent: " << (differ ? "yes" : "NO") << std::endl;
+
+    const size_t SIZE = 16 << 20;
+    std::vector<uint8_t> buffer(SIZE);
+    auto time_begin = std::chrono::steady_clock::now();
+    first.fill(buffer.data(), buffer.size());
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - time_begin;
+    std::cerr << "fill: " << SIZE / seconds.count() / (1 << 20) << " MiB/s" << std::endl;
+}
+
+void test_async() {
+
+    std::cout << std::endl << "test_async" << std::endl << std::endl;
+
+    const size_t COUNT = 1000;
+    std::vector<std::vector<uint8_t> > messages(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        messages[i].resize(i % 7 == 0 ? 100000 + i : i);
+        for (size_t j = 0; j < messages[i].size(); j++) {
+            messages[i][j] = (uint8_t)(i + j * 31);
+        }
+    }
+
+    // реактор: ждёт eventfd через poll(2) и отправляет новые задания, пока есть место
+    async_hash::Options options;
+    options.max_jobs = 64;
+    async_hash::Hasher hasher(options);
+    size_t submitted = 0, completed = 0, matched = 0, deferred = 0;
+    auto time_begin = std::chrono::steady_clock::now();
+    while (completed < COUNT) {
+        while (submitted < COUNT) {
+            auto bits = submitted % 2 == 0 ? 256 : 512;
+            auto id = hasher.try_submit(messages[submitted].data(), messages[submitted].size(), bits,
+                                        [&](const async_hash::Completion &completion) {
+                const auto &message = messages[(size_t)completion.user_data];
+                uint8_t digest[64];
+                if (completion.hash_bits == 256) {
+                    Streebog_256::hash(message.data(), message.size(), digest);
+                } else {
+                    Streebog_512::hash(message.data(), message.size(), digest);
+                }
+                matched += completion.status == async_hash::status_ok &&
+                           memcmp(digest, completion.digest.data(), completion.hash_bits / 8) == 0;
+                completed++;
+            }, (void *)submitted);
+            if (id == 0) {
+                deferred++;
+                break;
             }
-            cur_part |= prev_part << (128 - shift_size);
-            result.push_back(cur_part);
+            submitted++;
         }
+        pollfd descriptor = {hasher.event_fd(), POLLIN, 0};
+        ::poll(&descriptor, 1, 1000);
+        hasher.poll();
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - time_begin;
+    std::cout << "callbacks via eventfd match Streebog: " << (matched == COUNT ? "yes" : "NO") << std::endl;
+    std::cout << "backpressure deferred submissions: " << (deferred > 0 && hasher.in_flight() == 0 ? "yes" : "NO")
+              << std::endl;
+    std::cerr << "async: " << COUNT / seconds.count() << " jobs/s" << std::endl;
+
+    auto future = hasher.submit_future(messages[3].data(), messages[3].size(), 256);
+    std::cout << "future result: " << (future.get().digest == [&] {
+        std::array<uint8_t, 64> digest = {};
+        Streebog_256::hash(messages[3].data(), messages[3].size(), digest.data());
+        return digest;
+    }() ? "yes" : "NO") << std::endl;
+
+    // один поток: первое задание выполняется, второе ждёт в очереди
+    std::vector<uint8_t> large(64 << 20);
+    async_hash::Options single;
+    single.threads = 1;
+    single.max_bytes = 1 << 30;
+    async_hash::Hasher worker(single);
+    auto running = worker.submit_future(large.data(), large.size(), 512);
+    auto queued = worker.submit_future(large.data(), 1000, 512);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    bool cancelled = worker.cancel(2) && worker.cancel(1);
+    cancelled = cancelled && queued.get().status == async_hash::status_cancelled &&
+                running.get().status == async_hash::status_cancelled && !worker.cancel(1);
+    std::cout << "queued and running jobs cancelled: " << (cancelled ? "yes" : "NO") << std::endl;
+}
+
+void test_records() {
 
-        std::reverse(result.begin(), result.end());
+    std::cout << std::endl << "test_records (scanner: " << records::scanner_name() << ")" << std::endl << std::endl;
 
-        return result;
+    std::vector<uint8_t> lines, prefixed;
+    std::vector<std::vector<uint8_t> > expected;
+    std::mt19937 random(19);
+    for (size_t i = 0; i < 3000; i++) {
+        std::vector<uint8_t> record(random() % 300);
+        for (auto &byte : record) {
+            byte = (uint8_t)('a' + random() % 26);
+        }
+        lines.insert(lines.end(), record.begin(), record.end());
+        if (i + 1 < 3000) {
+            lines.push_back('\n');    // у последней строки нет '\n'
+        }
+        const uint8_t length[4] = {(uint8_t)record.size(), (uint8_t)(record.size() >> 8), 0, 0};
+        prefixed.insert(prefixed.end(), length, length + 4);
+        prefixed.insert(prefixed.end(), record.begin(), record.end());
+        expected.push_back(record);
     }
 
-    std::vector<__uint512_t> add_padding_and_group(const std::vector<__uint128_t> &message,
-                                                   size_t bits_length) const {
-        std::vector<__uint128_t> message_ = right_shifting(message, bits_length);
+    std::vector<size_t> positions;
+    records::find_all(lines.data(), lines.size(), '\n', positions);
+    bool found = positions.size() == expected.size() - 1;
+    for (auto position : positions) {
+        found = found && lines[position] == '\n';
+    }
+    std::cout << "newline scan finds every record boundary: " << (found ? "yes" : "NO") << std::endl;
 
-        if (bits_length % 512 != 0) {
-            std::reverse(message_.begin(), message_.end());
-            if (bits_length % 128 != 0) {
-                auto value = message_.back();
-                value |= (__int128_t) 1 << (bits_length % 128);
-                message_[message_.size() - 1] = value;
-            } else {
-                message_.push_back({1});
-                bits_length += 128;
+    auto check = [&](const std::vector<uint8_t> &input, records::Format format, bool binary, bool stream) {
+        records::Options options;
+        options.format = format;
+        options.binary = binary;
+        options.threads = 3;
+        options.segment_size = 4096;    // много сегментов и раундов
+        options.window_size = 200;      // записи до 300 байт: перенос хвоста и рост окна
+        std::string output, error;
+        records::Report report;
+        auto sink = [&](const uint8_t *data, size_t size) {
+            output.append((const char *)data, size);
+            return true;
+        };
+        bool ok;
+        if (stream) {
+            int pipe_fds[2];
+            if (pipe(pipe_fds) != 0) {
+                return false;
             }
+            std::thread writer([&] {
+                size_t written = 0;
+                while (written < input.size()) {
+                    auto count = write(pipe_fds[1], input.data() + written, std::min<size_t>(input.size() - written, 777));
+                    if (count <= 0) {
+                        break;
+                    }
+                    written += (size_t)count;
+                }
+                close(pipe_fds[1]);
+            });
+            ok = records::hash_stream(pipe_fds[0], options, sink, report, error);
+            writer.join();
+            close(pipe_fds[0]);
+        } else {
+            ok = records::hash_records(input.data(), input.size(), options, sink, report, error);
+        }
+        std::string reference;
+        for (const auto &record : expected) {
+            uint8_t digest[32];
+            Streebog_256::hash(record.data(), record.size(), digest);
+            reference += binary ? std::string((const char *)digest, 32) : utils::bytes_to_hex(digest, 32) + "\n";
+        }
+        return ok && report.records == expected.size() && output == reference;
+    };
+    std::cout << "lines, hex output matches Streebog: "
+              << (check(lines, records::format_lines, false, false) ? "yes" : "NO") << std::endl;
+    std::cout << "u32le, binary output matches Streebog: "
+              << (check(prefixed, records::format_u32le, true, false) ? "yes" : "NO") << std::endl;
+    std::cout << "lines from a pipe, read in windows: "
+              << (check(lines, records::format_lines, false, true) ? "yes" : "NO") << std::endl;
+    std::cout << "u32le from a pipe, read in windows: "
+              << (check(prefixed, records::format_u32le, true, true) ? "yes" : "NO") << std::endl;
+
+    prefixed.pop_back();
+    records::Report report;
+    std::string error;
+    bool rejected = !records::hash_records(prefixed.data(), prefixed.size(), {records::format_u32le},
+                                           [](const uint8_t *, size_t) { return true; }, report, error);
+    std::cout << "truncated record rejected: " << (rejected ? "yes" : "NO") << std::endl;
+}
 
-            auto need_blocks = (512 - bits_length) / 128;
-            for (auto i = 0; i < need_blocks; i++) {
-                message_.push_back({0});
+void test_hex() {
+
+    std::cout << std::endl << "test_hex (codec: " << hex::active().name << ")" << std::endl << std::endl;
+
+    std::vector<uint8_t> data(300), decoded(300);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t)(i * 89 + 7);
+    }
+
+    size_t count;
+    auto codecs = hex::all(count);
+    for (size_t c = 0; c < count; c++) {
+        if (!codecs[c].supported()) {
+            continue;
+        }
+        bool matches = true, rejects = true;
+        for (size_t length = 0; length <= 130; length++) {
+            std::string text(2 * length, '?');
+            codecs[c].encode(data.data(), length, &text[0]);
+            matches = matches && text == utils::bytes_to_hex(data.data(), length) &&
+                      codecs[c].decode(text.c_str(), length, decoded.data()) &&
+                      memcmp(decoded.data(), data.data(), length) == 0;
+
+            std::transform(text.begin(), text.end(), text.begin(), ::toupper);
+            matches = matches && codecs[c].decode(text.c_str(), length, decoded.data()) &&
+                      memcmp(decoded.data(), data.data(), length) == 0;
+
+            for (auto bad : {'g', 'G', '/', ':', '@', '`', ' ', '\xc1'}) {
+                if (length > 0) {
+                    auto corrupted = text;
+                    corrupted[(length * 7) % corrupted.size()] = bad;
+                    rejects = rejects && !codecs[c].decode(corrupted.c_str(), length, decoded.data());
+                }
             }
-            std::reverse(message_.begin(), message_.end());
         }
+        std::cout << codecs[c].name << " codec round-trips and rejects bad digits: "
+                  << (matches && rejects ? "yes" : "NO") << std::endl;
+    }
+
+    const size_t DIGESTS = 1000000;
+    std::vector<char> text(DIGESTS * 64);
+    auto time_begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < DIGESTS; i++) {
+        hex::encode(data.data() + i % 200, 32, text.data() + i * 64);
+    }
+    auto time_middle = std::chrono::steady_clock::now();
+    bool valid = true;
+    for (size_t i = 0; i < DIGESTS; i++) {
+        valid = hex::decode(text.data() + i * 64, 32, decoded.data()) && valid;
+    }
+    auto time_end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> encode_seconds = time_middle - time_begin;
+    std::chrono::duration<double> decode_seconds = time_end - time_middle;
+    std::cerr << "hex: " << DIGESTS / encode_seconds.count() << " digests/s encoded, "
+              << DIGESTS / decode_seconds.count() << " digests/s decoded" << (valid ? "" : " (INVALID)") << std::endl;
+}
+
+void test_digest_cache() {
+
+    std::cout << std::endl << "test_digest_cache" << std::endl << std::endl;
+
+    char path[] = "/tmp/stribog-cache-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cout << "digest cache: NO (mkstemp failed)" << std::endl;
+        return;
+    }
+    close(fd);
+    unlink(path);
 
-        auto total_blocks = message_.size() / 4;
+    // ключи с временем в прошлом, больше записей, чем помещается в начальную таблицу
+    const size_t FILES = 20000;
+    auto key_of = [](size_t i) {
+        return digest_cache::Key{1, 1000 + i, i * 7, 1000000000ULL * i, 1000000000ULL * i + 1};
+    };
+    auto digest_of = [](size_t i, uint8_t *digest) {
+        std::array<uint8_t, 8> input;
+        memcpy(input.data(), &i, sizeof(i));
+        auto result = Streebog_256::hash(input);
+        memcpy(digest, result.data(), result.size());
+    };
 
-        std::vector<__uint512_t> result;
+    std::string error;
+    bool stored;
+    {
+        digest_cache::Cache cache;
+        stored = cache.open(path, {true, 0}, error);
+        for (size_t i = 0; i < FILES && stored; i++) {
+            uint8_t digest[32], found[32];
+            digest_of(i, digest);
+            stored = cache.lookup(key_of(i), 256, found) == digest_cache::miss;
+            cache.record(key_of(i), 256, digest, nullptr);
+        }
+        stored = stored && cache.counters().entries == FILES && cache.error().empty() && cache.close(error);
+    }
+    std::cout << "stored " << FILES << " entries with table growth: " << (stored ? "yes" : "NO") << std::endl;
 
-        for (auto i = 0; i < total_blocks; i++) {
-            result.emplace_back();
-            for (int j = 0; j < 4; j++) {
-                result.back()[j] = message_[i * 4 + j];
+    // повторное открытие: поиск из нескольких потоков, изменённый файл -- промах
+    digest_cache::Cache cache;
+    bool reopened = cache.open(path, {true, 0}, error);
+    std::vector<uint8_t> digests(FILES * 32);
+    for (size_t i = 0; i < FILES; i++) {
+        digest_of(i, digests.data() + i * 32);
+    }
+    std::atomic<size_t> hits(0), wrong(0);
+    auto timer_begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < FILES; i += 4) {
+                uint8_t digest[32];
+                auto key = key_of(i);
+                if (i % 100 == 0) {
+                    key.ctime_ns++;
+                }
+                if (cache.lookup(key, 256, digest) == digest_cache::hit) {
+                    hits++;
+                    wrong += memcmp(digest, digests.data() + i * 32, 32) != 0 ? 1 : 0;
+                }
             }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto timer_end = std::chrono::steady_clock::now();
+    std::cout << "concurrent lookups find unchanged files only: "
+              << (reopened && hits == FILES - FILES / 100 && wrong == 0 ? "yes" : "NO") << std::endl;
+    std::chrono::duration<double> seconds = timer_end - timer_begin;
+    std::cerr << "digest cache: " << FILES / seconds.count() << " lookups/s" << std::endl;
+
+    // сжатие оставляет только записи, найденные в этом прогоне
+    uint8_t digest[32];
+    bool compacted = cache.compact(error) && cache.counters().entries == FILES - FILES / 100 &&
+                     cache.lookup(key_of(1), 256, digest) == digest_cache::hit &&
+                     cache.lookup(key_of(100), 256, digest) == digest_cache::miss && cache.close(error);
+    std::cout << "compaction drops entries not seen: " << (compacted ? "yes" : "NO") << std::endl;
+
+    // выборочная проверка и несовпадение
+    digest_cache::Cache sampled;
+    size_t verify = 0;
+    bool opened = sampled.open(path, {true, 0.1}, error);
+    for (size_t i = 1; i < 10000; i++) {
+        verify += sampled.lookup(key_of(i), 256, digest) == digest_cache::verify ? 1 : 0;
+    }
+    digest_of(2, digest);
+    digest[0] ^= 1;
+    uint8_t expected[32];
+    digest_of(2, expected);
+    bool counted = !sampled.record(key_of(2), 256, digest, expected) && sampled.counters().mismatches == 1;
+    std::cout << "verify sample of " << verify << " in 10000, mismatch counted: "
+              << (opened && verify > 800 && verify < 1200 && counted ? "yes" : "NO") << std::endl;
+    uint8_t kept[32];
+    bool kept_old = sampled.lookup(key_of(2), 256, kept) != digest_cache::miss && memcmp(kept, expected, 32) == 0;
+    std::cout << "mismatched digest does not replace the cached one: " << (kept_old ? "yes" : "NO") << std::endl;
+    sampled.close(error);
+
+    // второй процесс ждёт в open, пока первый не закроет кэш, и не теряет записи первого
+    int pipe_fds[2];
+    bool forked = pipe(pipe_fds) == 0;
+    pid_t child = forked ? fork() : -1;
+    if (child == 0) {
+        char byte;
+        digest_cache::Cache other;
+        std::string child_error;
+        bool ok = read(pipe_fds[0], &byte, 1) == 1 && other.open(path, {true, 0}, child_error);
+        for (size_t i = 0; i < 1000 && ok; i++) {
+            uint8_t found[32];
+            digest_of(FILES + i, digest);
+            ok = other.lookup(key_of(FILES + i), 256, found) == digest_cache::hit &&
+                 memcmp(found, digest, 32) == 0;
+            digest_of(FILES + 1000 + i, digest);
+            other.record(key_of(FILES + 1000 + i), 256, digest, nullptr);
+        }
+        _exit(ok && other.close(child_error) ? 0 : 1);
+    }
+    bool serialized = false;
+    if (child > 0) {
+        digest_cache::Cache first;
+        int status;
+        serialized = first.open(path, {true, 0}, error) && write(pipe_fds[1], "x", 1) == 1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        serialized = serialized && waitpid(child, &status, WNOHANG) == 0;
+        for (size_t i = 0; i < 1000; i++) {
+            digest_of(FILES + i, digest);
+            first.record(key_of(FILES + i), 256, digest, nullptr);
         }
-        return result;
+        serialized = first.close(error) && serialized;
+        serialized = waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                     serialized;
+        digest_cache::Cache reopened;
+        serialized = reopened.open(path, {true, 0}, error) && serialized;
+        for (size_t i = 0; i < 2000 && serialized; i++) {
+            uint8_t found[32];
+            digest_of(FILES + i, digest);
+            serialized = reopened.lookup(key_of(FILES + i), 256, found) == digest_cache::hit &&
+                         memcmp(found, digest, 32) == 0;
+        }
+        reopened.close(error);
+    }
+    if (forked) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
     }
+    std::cout << "second process waits for the lock and sees the first one's entries: "
+              << (serialized ? "yes" : "NO") << std::endl;
 
+    unlink(path);
+}
+
+void test_pair() {
 
-public:
-    explicit Stribog_hash(__uint512_t IV) {
-        IV_ = IV;
+    std::cout << std::endl << "test_pair" << std::endl << std::endl;
+
+    std::vector<uint8_t> message(1 << 20);
+    for (size_t i = 0; i < message.size(); i++) {
+        message[i] = (uint8_t)(i * 131 + (i >> 9));
     }
 
-    /**
-     * Полагаем, что сообщение придет с выравниванием к правому краю (если число бит не кратно 128,
-     * то незаполненным будет 0 элемент массива, а не последний).
-     */
-    std::vector<__uint128_t> hash(const std::vector<__uint128_t> &message,
-                                  size_t bits_length,
-                                  size_t hash_bits = 512) {
-        auto grouped_message = add_padding_and_group(message, bits_length);
-        __uint512_t h = IV_;
-        __uint512_t N = {0, 0, 0, 0};
-        __uint512_t Sigma = {0, 0, 0, 0};
+    // все ядра, разные длины и разбиения на куски
+    bool matches = true;
+    size_t count;
+    auto list = kernels::all(count);
+    compression::state_t m = {}, N = {};
+    for (size_t i = 0; i < 8; i++) {
+        m[i] = 0x0123456789abcdefULL * (i + 1);
+        N[i] = i * 512;
+    }
+    for (size_t k = 0; k < count; k++) {
+        if (!list[k].supported()) {
+            continue;
+        }
+        auto first = Streebog_256::IV, second = Streebog_512::IV;
+        list[k].g_pair(first, second, m, N);
+        matches = matches && first == list[k].g_function(Streebog_256::IV, m, N) &&
+                  second == list[k].g_function(Streebog_512::IV, m, N);
+    }
+    for (size_t length : {0, 1, 63, 64, 65, 127, 128, 1000, 4096 + 17}) {
+        uint8_t out256[32], out512[64];
+        Streebog_pair::hash(message.data(), length, out256, out512);
+        matches = matches && memcmp(out256, Streebog_256::hash(message.data(), length).data(), 32) == 0 &&
+                  memcmp(out512, Streebog_512::hash(message.data(), length).data(), 64) == 0;
 
-        std::reverse(grouped_message.begin(), grouped_message.end());
+        Streebog_pair context;
+        for (size_t offset = 0; offset < length; offset += 37) {
+            context.update(message.data() + offset, std::min<size_t>(37, length - offset));
+        }
+        uint8_t both[Streebog_pair::digest_size];
+        context.final(both);
+        matches = matches && memcmp(both, out256, 32) == 0 && memcmp(both + 32, out512, 64) == 0;
+    }
+    std::cout << "256 and 512 in one pass match separate digests: " << (matches ? "yes" : "NO") << std::endl;
 
-        //utils::print_hex_array(grouped_message);
+    uint8_t digest[Streebog_pair::digest_size];
+    auto time_begin = std::chrono::steady_clock::now();
+    Streebog_256::hash(message.data(), message.size(), digest);
+    Streebog_512::hash(message.data(), message.size(), digest + 32);
+    auto time_middle = std::chrono::steady_clock::now();
+    Streebog_pair::hash(message.data(), message.size(), digest);
+    auto time_end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> separate_seconds = time_middle - time_begin;
+    std::chrono::duration<double> pair_seconds = time_end - time_middle;
+    std::cerr << "both digests: " << message.size() / separate_seconds.count() / (1 << 20) << " MiB/s separately, "
+              << message.size() / pair_seconds.count() / (1 << 20) << " MiB/s in one pass (kernel "
+              << kernels::active().name << ")" << std::endl;
+}
 
-        for (auto i = 0; i < grouped_message.size() - 1; i++) {
-            h = g_function(h, grouped_message[i], N);
-            N = addition(N, {0, 0, 0, 512});
-            Sigma = addition(Sigma, grouped_message[i]);
-        };
+void test_tree() {
+
+    std::cout << std::endl << "test_tree" << std::endl << std::endl;
 
-        h = g_function(h, grouped_message.back(), N);
-        //utils::print_hex_array(h, "h value");
-        N = addition(N, {0, 0, 0, bits_length});
-        //utils::print_hex_array(N, "N value");
-        Sigma = addition(Sigma, grouped_message.back());
-        //utils::print_hex_array(Sigma, "Sigma value");
-        h = g_function(h, N, {0, 0, 0, 0});
-        h = g_function(h, Sigma, {0, 0, 0, 0});
-
-        if (hash_bits == 256) {
-            h = {h[0], h[1]};
+    char path[] = "/tmp/stribog-merkle-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cout << "tree: NO (mkstemp failed)" << std::endl;
+        return;
+    }
+    close(fd);
+    std::vector<uint8_t> data((5 << 20) + 12345);
+    std::mt19937_64 random(2012);
+    for (auto &byte : data) {
+        byte = (uint8_t)random();
+    }
+    std::ofstream(path, std::ios::binary).write((const char *)data.data(), (std::streamsize)data.size());
+
+    // один и тот же корень при любом числе потоков, из отображённого файла и из канала
+    tree_mode::Options options;
+    options.leaf_size = 65536;
+    auto expected = tree_mode::hash(data.data(), data.size(), options);
+    bool same = true;
+    std::string error;
+    for (size_t threads : {1, 3, 8}) {
+        options.threads = threads;
+        tree_mode::Result result;
+        same = same && tree_mode::hash_path(path, options, result, error) && result.root == expected.root &&
+               result.leaves == expected.leaves;
+
+        int pipe_fds[2];
+        if (pipe(pipe_fds) != 0) {
+            same = false;
+            break;
         }
-        return {h[0], h[1], h[2], h[3]};
+        std::thread writer([&] {
+            size_t offset = 0;
+            while (offset < data.size()) {
+                auto written = write(pipe_fds[1], data.data() + offset, std::min<size_t>(100000, data.size() - offset));
+                if (written <= 0) {
+                    break;
+                }
+                offset += (size_t)written;
+            }
+            close(pipe_fds[1]);
+        });
+        same = same && tree_mode::hash_path("/dev/fd/" + std::to_string(pipe_fds[0]), options, result, error) &&
+               result.root == expected.root && result.length == data.size();
+        writer.join();
+        close(pipe_fds[0]);
     }
+    std::cout << "root independent of threads and input path: " << (same ? "yes" : "NO") << std::endl;
 
-private:
+    // --verify-leaves через командную строку: находится ровно изменённый лист
+    std::string leaves_path = std::string(path) + ".leaves";
+    auto run = [](std::vector<std::string> args, std::string &output) {
+        std::vector<char *> argv;
+        for (auto &arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        std::ostringstream captured;
+        auto saved = std::cout.rdbuf(captured.rdbuf());
+        auto status = sum_tool::run((int)argv.size(), argv.data());
+        std::cout.rdbuf(saved);
+        output = captured.str();
+        return status;
+    };
+    std::string output;
+    bool written = run({"Stribog", "--tree", "--leaf-size", "65536", "--leaves", leaves_path, path}, output) == 0;
+    data[5 * 65536 + 100] ^= 1;
+    std::fstream(path, std::ios::binary | std::ios::in | std::ios::out).seekp(5 * 65536 + 100)
+            .write((const char *)&data[5 * 65536 + 100], 1);
+    bool found = written && run({"Stribog", "--tree", "--leaf-size", "65536", "--verify-leaves", leaves_path, path},
+                                output) == 1 &&
+                 output == std::string(path) + ": leaf 5 at offset 327680: FAILED\n";
+    std::cout << "verify-leaves reports only the modified leaf: " << (found ? "yes" : "NO") << std::endl;
 
-    __uint512_t IV_;
-};
+    // файл листьев с другим размером листа отвергается, а не даёт ложные несовпадения
+    bool rejected = run({"Stribog", "--tree", "--leaf-size", "32768", "--verify-leaves", leaves_path, path},
+                        output) == 1 && output.empty();
+    std::cout << "leaves written with another leaf size rejected: " << (rejected ? "yes" : "NO") << std::endl;
 
-void test_utils() {
-    const char *message_str = "00112233445566778899AABBCCDDEEFF\0";
-    auto value = utils::parse_hex<__uint128_t>(message_str);
-    utils::print_hex<__uint128_t>(value);
-};
+    // диапазон за концом файла -- ошибка, а не проверка последнего листа
+    bool past_end = run({"Stribog", "--tree", "--leaf-size", "65536", "--verify-leaves", leaves_path, "--range",
+                         std::to_string(data.size()) + ":1", path}, output) == 1 && output.empty();
+    std::cout << "range past the end rejected: " << (past_end ? "yes" : "NO") << std::endl;
 
-void test_stribog() {
+    unlink(leaves_path.c_str());
+    unlink(path);
+}
 
-    std::cout << std::endl << "test_stribog" << std::endl << std::endl;
+void test_daemon() {
 
-    Stribog_hash stribog({0, 0, 0, 0});
-    const char *message_str = "323130393837363534333231303938373635343332313039383736353433323130393837363534333231303938373635343332313039383736353433323130\0";
+    std::cout << std::endl << "test_daemon" << std::endl << std::endl;
 
-    auto message_length = strlen(message_str);
+    hash_daemon::Server_options options;
+    options.socket_path = "/tmp/stribog-daemon-" + std::to_string(getpid()) + ".sock";
+    options.batch_window = std::chrono::microseconds(100);
+    options.max_connections = 2;       // четыре клиента ниже по очереди ждут свободного места
+    bool served = false;
+    std::string server_error;
+    std::thread server([&] { served = hash_daemon::serve(options, server_error); });
 
-    std::vector<__uint128_t> message;
-    for (int i = 0; i < 4; i++) {
-        message.push_back(utils::parse_hex<__uint128_t>(message_str + 32 * i));
+    // сокет появляется не сразу после запуска потока
+    std::string error;
+    bool connected = false;
+    for (int attempt = 0; attempt < 200 && !connected; attempt++) {
+        hash_daemon::Client client;
+        connected = client.connect(options.socket_path, error);
+        if (!connected) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
     }
 
-    for (int i = 0; i < 4; i++) {
-        utils::print_hex(message[i]);
+    uint8_t key[32];
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 7);
+    }
+    std::vector<uint8_t> payload(100000);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = (uint8_t)(i * 131 + (i >> 10));
     }
 
-    std::cout << std::endl << std::endl;
+    // hash, HMAC и verify через данные в сокете и через memfd; маленькие запросы идут в пакеты
+    bool matches = connected;
+    for (bool memfd : {false, true}) {
+        for (size_t length : {size_t(0), size_t(64), payload.size()}) {
+            int payload_fd = -1;
+            if (memfd) {
+                payload_fd = memfd_create("stribog-test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+                if (payload_fd < 0 || write(payload_fd, payload.data(), length) != (ssize_t)length ||
+                    fcntl(payload_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_WRITE) != 0) {
+                    matches = false;
+                    break;
+                }
+            }
+            hash_daemon::Client client;
+            matches = matches && client.connect(options.socket_path, error);
+            for (size_t hash_bits : {256, 512}) {
+                std::vector<uint8_t> expected(hash_bits / 8), mac(hash_bits / 8), digest;
+                if (hash_bits == 256) {
+                    Streebog_256::hash(payload.data(), length, expected.data());
+                    Hmac_256::mac(key, sizeof(key), payload.data(), length, mac.data());
+                } else {
+                    Streebog_512::hash(payload.data(), length, expected.data());
+                    Hmac_512::mac(key, sizeof(key), payload.data(), length, mac.data());
+                }
+                hash_daemon::Status status;
+                matches = matches && client.request(hash_daemon::operation_hash, hash_bits, nullptr, 0, nullptr, 0,
+                                                    payload.data(), length, payload_fd, status, digest, error) &&
+                          status == hash_daemon::status_ok && digest == expected;
+                matches = matches && client.request(hash_daemon::operation_hmac, hash_bits, key, sizeof(key),
+                                                    nullptr, 0, payload.data(), length, payload_fd, status, digest,
+                                                    error) &&
+                          status == hash_daemon::status_ok && digest == mac;
+                matches = matches && client.request(hash_daemon::operation_verify, hash_bits, key, sizeof(key),
+                                                    mac.data(), mac.size(), payload.data(), length, payload_fd,
+                                                    status, digest, error) &&
+                          status == hash_daemon::status_ok;
+                expected[0] ^= 1;
+                matches = matches && client.request(hash_daemon::operation_verify, hash_bits, nullptr, 0,
+                                                    expected.data(), expected.size(), payload.data(), length,
+                                                    payload_fd, status, digest, error) &&
+                          status == hash_daemon::status_mismatch;
+            }
+            if (payload_fd >= 0) {
+                close(payload_fd);
+            }
+        }
+    }
+    std::cout << "hash, HMAC and verify through Client, inline and memfd: " << (matches ? "yes" : "NO") << std::endl;
 
-    auto hash = stribog.hash(message, message_length * 4);
+    // незапечатанный memfd клиент мог бы укоротить во время хеширования
+    bool rejected = false;
+    int unsealed = memfd_create("stribog-test", MFD_CLOEXEC);
+    if (unsealed >= 0 && write(unsealed, payload.data(), 4096) == 4096) {
+        hash_daemon::Client client;
+        hash_daemon::Status status;
+        std::vector<uint8_t> digest;
+        rejected = client.connect(options.socket_path, error) &&
+                   client.request(hash_daemon::operation_hash, 256, nullptr, 0, nullptr, 0, nullptr, 4096, unsealed,
+                                  status, digest, error) &&
+                   status == hash_daemon::status_bad_request;
+    }
+    if (unsealed >= 0) {
+        close(unsealed);
+    }
+    std::cout << "unsealed memfd rejected: " << (rejected ? "yes" : "NO") << std::endl;
 
-    for (const auto &value : hash) {
-        utils::print_hex(value);
+    // несколько соединений одновременно (больше max_connections) -- запросы собираются в пакеты
+    std::atomic<size_t> wrong(0);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < 4; c++) {
+        clients.emplace_back([&, c] {
+            hash_daemon::Client client;
+            std::string client_error;
+            if (!client.connect(options.socket_path, client_error)) {
+                wrong++;
+                return;
+            }
+            for (size_t i = 0; i < 200; i++) {
+                auto length = (c * 200 + i) % 300;
+                hash_daemon::Status status;
+                std::vector<uint8_t> digest;
+                auto expected = Streebog_256::hash(payload.data() + i, length);
+                if (!client.request(hash_daemon::operation_hash, 256, nullptr, 0, nullptr, 0, payload.data() + i,
+                                    length, -1, status, digest, client_error) ||
+                    status != hash_daemon::status_ok || memcmp(digest.data(), expected.data(), 32) != 0) {
+                    wrong++;
+                }
+            }
+        });
     }
-    const char *result_hash = "486f64c1917879417fef082b3381a4e211c324f074654c38823a7b76f830ad00fa1fbae42b1285c0352f227524bc9ab16254288dd6863dccd5b9f54a1ad0541b\0";
-    std::cout << result_hash << std::endl;
+    for (auto &client : clients) {
+        client.join();
+    }
+    std::cout << "concurrent batched requests answered correctly: " << (connected && wrong == 0 ? "yes" : "NO")
+              << std::endl;
 
-    const size_t SIZE = 1 * 1000;
-    auto time_begin = std::chrono::steady_clock::now();
-    for (int i = 0; i < SIZE; i++) {
-        stribog.hash(hash, 512);
+    // serve работает до сигнала; после остановки возвращаем обработчики по умолчанию. Без
+    // соединения обработчик мог быть ещё не установлен -- тогда serve уже вернулся с ошибкой
+    if (connected) {
+        raise(SIGTERM);
     }
-    auto time_end = std::chrono::steady_clock::now();
-    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_begin).count();
-    std::cerr << "encode: " << 512 / 8.0 * SIZE / milliseconds / 1024.0 << " MB/s" << std::endl;
+    server.join();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    std::cout << "daemon stops on SIGTERM: " << (served ? "yes" : "NO") << std::endl;
+}
+
+void test_dir_hasher() {
+
+    std::cout << std::endl << "test_dir_hasher" << std::endl << std::endl;
+
+    char directory[] = "/tmp/stribog-tree-XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::cout << "dir hasher: NO (mkdtemp failed)" << std::endl;
+        return;
+    }
+    std::string root = directory;
+    mkdir((root + "/sub").c_str(), 0755);
+
+    // размеры вокруг границы чтения и файл больше порога mmap в file_hash
+    std::vector<std::string> paths;
+    std::mt19937_64 random(2012);
+    size_t index = 0;
+    for (size_t size : {0, 1, 4095, 4096, 4097, 100000, 3 << 20}) {
+        std::vector<uint8_t> data(size);
+        for (auto &byte : data) {
+            byte = (uint8_t)random();
+        }
+        for (auto parent : {"/", "/sub/"}) {
+            paths.push_back(root + parent + std::to_string(index++));
+            std::ofstream(paths.back(), std::ios::binary).write((const char *)data.data(), (std::streamsize)data.size());
+        }
+    }
+
+    for (bool use_uring : {true, false}) {
+        dir_hasher::Options options;
+        options.chunk_size = 4096;
+        options.buffers = 8;
+        options.max_open_files = 4;
+        options.use_uring = use_uring;
+        size_t files = 0, matched = 0;
+        auto report = dir_hasher::hash_tree({root}, options, [&](const std::string &path, const uint8_t *digest,
+                                                                const std::string &) {
+            uint8_t expected[32];
+            std::string error;
+            files++;
+            matched += digest != nullptr && file_hash::hash_path(path, 256, expected, error) &&
+                       memcmp(digest, expected, sizeof(expected)) == 0 ? 1 : 0;
+        });
+        std::cout << report.backend << " tree digests match file_hash: "
+                  << (files == paths.size() && matched == paths.size() && report.failed == 0 ? "yes" : "NO")
+                  << std::endl;
+    }
+
+    for (const auto &path : paths) {
+        unlink(path.c_str());
+    }
+    rmdir((root + "/sub").c_str());
+    rmdir(directory);
 }
 
-int main() {
+int main(int argc, char **argv) {
+
+    if (argc > 1 && (strcmp(argv[1], "--daemon") == 0 || strcmp(argv[1], "--load") == 0)) {
+        return hash_daemon::run(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--ingest") == 0) {
+        return chunk_store::run(argc, argv);
+    }
+    if (argc < 2 || strcmp(argv[1], "--self-test") != 0) {
+        return sum_tool::run(argc, argv);
+    }
 
     test_utils();
 
     test_stribog();
 
+    test_streaming();
+
+    test_multibuffer();
+
+    test_kernels();
+
+    test_checkpoint();
+
+    test_hmac();
+
+    test_fixed();
+
+    test_c_abi();
+
+    test_chunker();
+
+    test_drbg();
+
+    test_async();
+
+    test_records();
+
+    test_hex();
+
+    test_pair();
+
+    test_digest_cache();
+
+    test_dir_hasher();
+
+    test_tree();
+
+    test_daemon();
+
     return 0;
-}
\ No newline at end of file
+}
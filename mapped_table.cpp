@@ -0,0 +1,210 @@
+#include "mapped_table.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mapped_table {
+
+namespace {
+
+const size_t page_size = 4096;
+
+bool lock_file(int fd) {
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+};
+
+Table::~Table() {
+    close();
+}
+
+void Table::close() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool Table::open(const std::string &path, uint32_t tag, uint64_t extra, uint64_t initial_capacity, bool lock,
+                 std::string &error) {
+    close();
+    path_ = path;
+    lock_ = lock;
+
+    while (true) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            error = path + ": " + strerror(errno);
+            return false;
+        }
+        if (!lock) {
+            break;
+        }
+        if (!lock_file(fd_)) {
+            error = path + ": " + strerror(errno);
+            close();
+            return false;
+        }
+        // пока ждали, владелец мог заменить файл через rename -- тогда заблокирован старый
+        struct stat opened, current;
+        if (fstat(fd_, &opened) == 0 && stat(path.c_str(), &current) == 0 && opened.st_dev == current.st_dev &&
+            opened.st_ino == current.st_ino) {
+            break;
+        }
+        close();
+    }
+
+    struct stat info;
+    if (fstat(fd_, &info) != 0) {
+        error = path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    if (info.st_size == 0) {
+        return rebuild(initial_capacity, tag, extra, Keep(), error);
+    }
+
+    auto size = (size_t)info.st_size;
+    Header header;
+    if (size < sizeof(header) || pread(fd_, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, format_.magic, sizeof(header.magic)) != 0 || header.version != format_.version ||
+        header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 ||
+        size != sizeof(Header) + header.capacity * format_.entry_size) {
+        error = path + ": not a " + format_.name + " or unsupported version";
+        close();
+        return false;
+    }
+
+    auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+        error = path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    data_ = (uint8_t *)data;
+    size_ = size;
+    return true;
+}
+
+bool Table::rebuild(uint64_t capacity, uint32_t tag, uint64_t extra, const Keep &keep, std::string &error) {
+    return replace(capacity, tag, extra, keep, true, error);
+}
+
+bool Table::replace(uint64_t capacity, uint32_t tag, uint64_t extra, const Keep &keep, bool clean,
+                    std::string &error) {
+    auto temporary = path_ + ".tmp";
+    int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = temporary + ": " + strerror(errno);
+        return false;
+    }
+    auto size = sizeof(Header) + capacity * format_.entry_size;
+    void *data = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (data == MAP_FAILED) {
+        error = temporary + ": " + strerror(errno);
+        ::close(fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    auto header = (Header *)data;
+    memcpy(header->magic, format_.magic, sizeof(header->magic));
+    header->version = format_.version;
+    header->tag = tag;
+    header->capacity = capacity;
+    header->extra = extra;
+
+    auto target = (uint8_t *)data + sizeof(Header);
+    if (data_ != nullptr && keep) {
+        auto old_capacity = this->header()->capacity;
+        auto old_entries = data_ + sizeof(Header);
+        for (uint64_t i = 0; i < old_capacity; i++) {
+            auto entry = old_entries + i * format_.entry_size;
+            if (!format_.used(entry) || !keep(entry)) {
+                continue;
+            }
+            auto slot = format_.slot(entry, capacity);
+            while (format_.used(target + slot * format_.entry_size)) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            memcpy(target + slot * format_.entry_size, entry, format_.entry_size);
+            header->count++;
+        }
+    }
+    header->clean = clean ? 1 : 0;
+
+    // новый файл блокируется до rename: ждущий процесс после замены сразу упрётся в эту блокировку,
+    // а на диске он должен оказаться раньше, чем rename заменит им старый
+    if ((lock_ && !lock_file(fd)) || msync(data, size, MS_SYNC) != 0 || rename(temporary.c_str(), path_.c_str()) != 0) {
+        error = path_ + ": " + strerror(errno);
+        munmap(data, size);
+        ::close(fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    close();
+    fd_ = fd;
+    data_ = (uint8_t *)data;
+    size_ = size;
+    return true;
+}
+
+bool Table::prepare_insert(std::string &error) {
+    // выросшая таблица сразу помечена изменённой: вставка последует, а старые поля tag и extra
+    // после сбоя не должны выдать её за согласованную
+    auto header = this->header();
+    if ((header->count + 1) * 4 > header->capacity * 3 &&
+        !replace(header->capacity * 2, header->tag, header->extra, [](const void *) { return true; }, false,
+                 error)) {
+        return false;
+    }
+    return mark_dirty(error);
+}
+
+bool Table::mark_dirty(std::string &error) {
+    auto header = this->header();
+    if (header->clean) {
+        header->clean = 0;
+        if (msync(data_, page_size, MS_SYNC) != 0) {
+            error = path_ + ": " + strerror(errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Table::sync(std::string &error) {
+    if (msync(data_, size_, MS_SYNC) != 0) {
+        error = path_ + ": " + strerror(errno);
+        return false;
+    }
+    header()->clean = 1;
+    if (msync(data_, page_size, MS_SYNC) != 0) {
+        error = path_ + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+};
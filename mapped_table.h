@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * Хеш-таблица с открытой адресацией в отображённом в память файле: общая основа индекса
+ * chunk_store и кэша digest_cache.
+ *
+ * Файл -- заголовок 64 байта и capacity записей фиксированного размера. Таблица растёт удвоением
+ * при заполнении на 3/4: записи переносятся в новый файл, который заменяет старый через rename.
+ * Перед первым изменением на диск пишется отметка "изменён", после sync -- снова "согласован",
+ * так что после сбоя владелец видит, что записям верить нельзя. Поиск и вставку по ключу делает
+ * владелец: таблица не знает, что лежит в записях, кроме признака занятости и номера ячейки.
+ */
+namespace mapped_table {
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t tag;           // поле формата: размер дайджеста индекса, поколение кэша
+    uint64_t capacity;      // степень двойки
+    uint64_t count;
+    uint64_t extra;         // поле формата: размер файла данных индекса
+    uint64_t clean;         // 0 -- записи могли быть изменены без sync
+    uint64_t reserved[2];
+};
+
+static_assert(sizeof(Header) == 64, "table format");
+
+struct Format {
+    const char *name;       // для сообщения о чужом файле
+    char magic[8];
+    uint32_t version;
+    size_t entry_size;
+    bool (*used)(const void *entry);
+    uint64_t (*slot)(const void *entry, uint64_t capacity);
+};
+
+/**
+ * Отбор записей при перестроении таблицы; пустая функция -- таблица перестраивается пустой.
+ */
+using Keep = std::function<bool(const void *entry)>;
+
+class Table {
+public:
+    explicit Table(const Format &format) : format_(format) {
+    }
+
+    Table(const Table &) = delete;
+    Table &operator=(const Table &) = delete;
+
+    ~Table();
+
+    /**
+     * Открывает файл таблицы; если его нет (или он пуст после сбоя при создании), создаёт пустую
+     * таблицу из initial_capacity записей с полями tag и extra. Файл чужого формата -- ошибка.
+     * С lock файл до close заблокирован flock(LOCK_EX): другой процесс ждёт в open, пока таблица
+     * не будет закрыта, и не видит недописанных записей.
+     */
+    bool open(const std::string &path, uint32_t tag, uint64_t extra, uint64_t initial_capacity, bool lock,
+              std::string &error);
+
+    /**
+     * Атомарно заменяет файл таблицей из capacity записей, в которую перенесены отобранные keep.
+     * Новый файл согласован (clean) и становится текущим.
+     */
+    bool rebuild(uint64_t capacity, uint32_t tag, uint64_t extra, const Keep &keep, std::string &error);
+
+    /**
+     * Вызывается перед вставкой новой записи: удваивает заполненную на 3/4 таблицу и помечает её
+     * изменённой. Указатели на записи после вызова недействительны.
+     */
+    bool prepare_insert(std::string &error);
+
+    /**
+     * Помечает таблицу изменённой; отметка попадает на диск раньше самих записей.
+     */
+    bool mark_dirty(std::string &error);
+
+    /**
+     * Сбрасывает записи на диск и помечает таблицу согласованной.
+     */
+    bool sync(std::string &error);
+
+    /**
+     * Закрывает файл и снимает блокировку.
+     */
+    void close();
+
+    bool is_open() const {
+        return data_ != nullptr;
+    }
+
+    Header *header() const {
+        return (Header *)data_;
+    }
+
+    template<typename Entry>
+    Entry *entries() const {
+        return (Entry *)(data_ + sizeof(Header));
+    }
+
+    uint64_t next(uint64_t slot) const {
+        return (slot + 1) & (header()->capacity - 1);
+    }
+
+    const std::string &path() const {
+        return path_;
+    }
+
+private:
+    bool replace(uint64_t capacity, uint32_t tag, uint64_t extra, const Keep &keep, bool clean, std::string &error);
+
+    const Format &format_;
+    std::string path_;
+    bool lock_ = false;
+    int fd_ = -1;
+    uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+};
@@ -0,0 +1,271 @@
+#include "multibuffer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+
+#include "compression.h"
+#include "kernels.h"
+#include "stats.h"
+#include "streebog.h"
+
+namespace multibuffer {
+
+namespace {
+
+const size_t max_lanes = 8;
+
+/**
+ * Состояния всех линий хранятся "по словам": value[limb * lanes + lane],
+ * так что слово limb всех линий загружается одним векторным чтением.
+ */
+struct Lane_block {
+    alignas(64) uint64_t h[8 * max_lanes];
+    alignas(64) uint64_t m[8 * max_lanes];
+    alignas(64) uint64_t N[8 * max_lanes];
+};
+
+using g_kernel_t = void (*)(Lane_block &block);
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+inline void lps_avx512(__m512i *x) {
+    const auto &table = compression::lps_table;
+    const __m512i byte_mask = _mm512_set1_epi64(0xff);
+
+    __m512i result[8];
+    for (int i = 0; i < 8; i++) {
+        result[i] = _mm512_setzero_si512();
+    }
+    for (int j = 0; j < 8; j++) {
+        auto bytes = x[j];
+        for (int i = 0; i < 8; i++) {
+            auto index = _mm512_and_si512(bytes, byte_mask);
+            result[i] = _mm512_xor_si512(result[i], _mm512_i64gather_epi64(index, table[j].data(), 8));
+            bytes = _mm512_srli_epi64(bytes, 8);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        x[i] = result[i];
+    }
+}
+
+void g_avx512(Lane_block &block) {
+    const auto &c_values = compression::iteration_constants;
+    const size_t lanes = 8;
+
+    __m512i h[8], m[8], key[8], value[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm512_load_si512(block.h + i * lanes);
+        m[i] = _mm512_load_si512(block.m + i * lanes);
+        key[i] = _mm512_xor_si512(h[i], _mm512_load_si512(block.N + i * lanes));
+    }
+    lps_avx512(key);
+
+    for (int i = 0; i < 8; i++) {
+        value[i] = _mm512_xor_si512(key[i], m[i]);
+    }
+    for (int round = 0; round < 12; round++) {
+        lps_avx512(value);
+        for (int i = 0; i < 8; i++) {
+            key[i] = _mm512_xor_si512(key[i], _mm512_set1_epi64((long long)c_values[round][i]));
+        }
+        lps_avx512(key);
+        for (int i = 0; i < 8; i++) {
+            value[i] = _mm512_xor_si512(value[i], key[i]);
+        }
+    }
+
+    for (int i = 0; i < 8; i++) {
+        value[i] = _mm512_xor_si512(value[i], _mm512_xor_si512(h[i], m[i]));
+        _mm512_store_si512(block.h + i * lanes, value[i]);
+    }
+}
+
+#pragma GCC pop_options
+
+struct Engine {
+    size_t lanes;
+    g_kernel_t g;
+};
+
+Engine select_engine() {
+    __builtin_cpu_init();
+
+    const char *forced = getenv("STRIBOG_KERNEL");
+    if (forced != nullptr && kernels::find(forced) != nullptr) {
+        if (strcmp(forced, "avx512") == 0) {
+            return {8, g_avx512};
+        }
+        return {1, nullptr};
+    }
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return {8, g_avx512};
+    }
+    // Четыре линии на AVX2 проигрывали скалярному табличному циклу: 64 gather на LPS дороже
+    // 64 обычных загрузок на каждое сообщение, поэтому без AVX-512 сообщения хешируются по одному.
+    return {1, nullptr};
+}
+
+const Engine &get_engine() {
+    static const Engine engine = select_engine();
+    return engine;
+}
+
+/**
+ * Этапы обработки одного сообщения в линии -- те же, что у Streebog::update / final.
+ */
+enum class Stage {
+    data,
+    last_block,
+    length_block,
+    sum_block,
+    idle
+};
+
+struct Lane {
+    Stage stage = Stage::idle;
+    size_t message = 0;
+    size_t offset = 0;
+    compression::state_t N = {};
+    compression::state_t Sigma = {};
+    compression::state_t m = {};
+};
+
+void hash_lanes(const Engine &engine, const uint8_t *const *messages, const size_t *lengths, size_t count,
+                uint8_t *out, size_t hash_bits) {
+    const size_t lanes = engine.lanes;
+    const size_t digest_size = hash_bits / 8;
+    const auto &IV = hash_bits == 256 ? Streebog_256::IV : Streebog_512::IV;
+
+    Lane_block block = {};
+    Lane lane_state[max_lanes];
+    size_t next_message = 0;
+    size_t active = 0;
+
+    auto start_message = [&](size_t lane) {
+        auto &state = lane_state[lane];
+        state = Lane();
+        if (next_message == count) {
+            return;
+        }
+        state.stage = lengths[next_message] >= Streebog_512::block_size ? Stage::data : Stage::last_block;
+        state.message = next_message++;
+        STRIBOG_STATS_ADD(bytes_hashed, lengths[state.message]);
+        for (int i = 0; i < 8; i++) {
+            block.h[i * lanes + lane] = IV[i];
+        }
+        active++;
+    };
+
+    for (size_t lane = 0; lane < lanes; lane++) {
+        start_message(lane);
+    }
+
+    while (active > 0) {
+        for (size_t lane = 0; lane < lanes; lane++) {
+            auto &state = lane_state[lane];
+            const compression::state_t *key_addend = &state.N;
+
+            switch (state.stage) {
+                case Stage::data:
+                    memcpy(state.m.data(), messages[state.message] + state.offset, Streebog_512::block_size);
+                    break;
+                case Stage::last_block: {
+                    auto tail = lengths[state.message] - state.offset;
+                    auto *bytes = (uint8_t *)state.m.data();
+                    memset(bytes, 0, Streebog_512::block_size);
+                    if (tail > 0) {
+                        memcpy(bytes, messages[state.message] + state.offset, tail);
+                    }
+                    bytes[tail] = 0x01;
+                    break;
+                }
+                case Stage::length_block:
+                case Stage::sum_block: {
+                    static const compression::state_t zero = {};
+                    state.m = state.stage == Stage::length_block ? state.N : state.Sigma;
+                    key_addend = &zero;
+                    break;
+                }
+                case Stage::idle:
+                    state.m.fill(0);
+                    break;
+            }
+
+            for (int i = 0; i < 8; i++) {
+                block.m[i * lanes + lane] = state.m[i];
+                block.N[i * lanes + lane] = (*key_addend)[i];
+            }
+        }
+
+        {
+            STRIBOG_STATS_TIME(compress);
+            STRIBOG_STATS_ADD(blocks_compressed, active);
+            engine.g(block);
+        }
+
+        for (size_t lane = 0; lane < lanes; lane++) {
+            auto &state = lane_state[lane];
+            switch (state.stage) {
+                case Stage::data:
+                    compression::add(state.N, 512);
+                    compression::add(state.Sigma, state.m);
+                    state.offset += Streebog_512::block_size;
+                    if (lengths[state.message] - state.offset < Streebog_512::block_size) {
+                        state.stage = Stage::last_block;
+                    }
+                    break;
+                case Stage::last_block:
+                    compression::add(state.N, (lengths[state.message] - state.offset) * 8);
+                    compression::add(state.Sigma, state.m);
+                    state.stage = Stage::length_block;
+                    break;
+                case Stage::length_block:
+                    state.stage = Stage::sum_block;
+                    break;
+                case Stage::sum_block: {
+                    uint64_t h[8];
+                    for (int i = 0; i < 8; i++) {
+                        h[i] = block.h[i * lanes + lane];
+                    }
+                    memcpy(out + state.message * digest_size, h + 8 - digest_size / 8, digest_size);
+                    active--;
+                    start_message(lane);
+                    break;
+                }
+                case Stage::idle:
+                    break;
+            }
+        }
+    }
+}
+
+};
+
+size_t lanes() {
+    return get_engine().lanes;
+}
+
+void hash_many(const uint8_t *const *messages, const size_t *lengths, size_t count, uint8_t *out,
+               size_t hash_bits) {
+    const auto &engine = get_engine();
+    const size_t digest_size = hash_bits / 8;
+
+    if (engine.lanes == 1 || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            if (hash_bits == 256) {
+                Streebog_256::hash(messages[i], lengths[i], out + i * digest_size);
+            } else {
+                Streebog_512::hash(messages[i], lengths[i], out + i * digest_size);
+            }
+        }
+        return;
+    }
+
+    hash_lanes(engine, messages, lengths, count, out, hash_bits);
+}
+
+};
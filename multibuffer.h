@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Многобуферное хеширование: независимые сообщения распределяются по восьми линиям AVX-512,
+ * и одна векторная функция сжатия продвигает сразу все линии. Без AVX-512 (или при
+ * STRIBOG_KERNEL, отличном от avx512) сообщения хешируются по одному через Streebog::hash.
+ *
+ * Длины сообщений произвольные: линия, закончившая своё сообщение (данные, дополненный блок,
+ * блоки N и Sigma), сразу получает следующее из очереди.
+ */
+namespace multibuffer {
+
+/**
+ * Число линий, которое будет использовано на этой машине (1 -- векторный путь недоступен).
+ */
+size_t lanes();
+
+/**
+ * Хеширует count сообщений; out должен вмещать count * hash_bits / 8 байт,
+ * результат i-го сообщения лежит по смещению i * hash_bits / 8.
+ */
+void hash_many(const uint8_t *const *messages, const size_t *lengths, size_t count, uint8_t *out,
+               size_t hash_bits = 512);
+
+};
@@ -0,0 +1,85 @@
+#include "perf_counters.h"
+
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace perf {
+
+namespace {
+
+struct Event_config {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const Event_config event_configs[event_count] = {
+        {"cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"cache_references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+        {"cache_misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {"branch_misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+int open_event(const Event_config &config, int group_fd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = config.type;
+    attr.config = config.config;
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+};
+
+const char *event_name(Event event) {
+    return event_configs[event].name;
+}
+
+Counter_group::Counter_group() {
+    // циклы -- лидер группы: без него остальные счётчики не имеют смысла
+    fds_[cycles] = open_event(event_configs[cycles], -1);
+    for (int event = cycles + 1; event < event_count; event++) {
+        fds_[event] = available() ? open_event(event_configs[event], fds_[cycles]) : -1;
+    }
+}
+
+Counter_group::~Counter_group() {
+    for (auto fd : fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void Counter_group::start() {
+    if (available()) {
+        ioctl(fds_[cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds_[cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+Counters Counter_group::stop() {
+    Counters result;
+    if (!available()) {
+        return result;
+    }
+    ioctl(fds_[cycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    for (int event = 0; event < event_count; event++) {
+        uint64_t value;
+        if (fds_[event] >= 0 && read(fds_[event], &value, sizeof(value)) == sizeof(value)) {
+            result.values[event] = value;
+            result.valid[event] = true;
+        }
+    }
+    return result;
+}
+
+};
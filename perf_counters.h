@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <x86intrin.h>
+
+/**
+ * Счётчики производительности для замеров.
+ *
+ * read_tsc() -- такты TSC (опорная частота, не зависит от турбо-режима), доступны всегда.
+ * Counter_group -- аппаратные счётчики текущего потока через perf_event_open (только user space);
+ * на виртуальных машинах и при perf_event_paranoid > 2 их может не быть, тогда available() == false.
+ */
+namespace perf {
+
+inline uint64_t read_tsc() {
+    return __rdtsc();
+}
+
+enum Event {
+    cycles,
+    instructions,
+    cache_references,
+    cache_misses,
+    branch_misses,
+    event_count
+};
+
+const char *event_name(Event event);
+
+struct Counters {
+    uint64_t values[event_count] = {};
+    bool valid[event_count] = {};
+
+    bool any() const {
+        for (auto value : valid) {
+            if (value) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+class Counter_group {
+public:
+    Counter_group();
+    Counter_group(const Counter_group &) = delete;
+    Counter_group &operator=(const Counter_group &) = delete;
+
+    ~Counter_group();
+
+    bool available() const {
+        return fds_[cycles] >= 0;
+    }
+
+    void start();
+
+    Counters stop();
+
+private:
+    int fds_[event_count];
+};
+
+};
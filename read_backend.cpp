@@ -0,0 +1,290 @@
+#include "read_backend.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+namespace read_backend {
+
+namespace {
+
+/**
+ * Минимальная обёртка над системными вызовами io_uring без liburing: одно кольцо отправки,
+ * одно кольцо завершений, только IORING_OP_READ.
+ */
+class Uring_backend : public Backend {
+public:
+    ~Uring_backend() override {
+        if (sqes_ != MAP_FAILED && sqes_ != nullptr) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED && sq_ring_ != nullptr) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool init(unsigned depth) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd_ = (int)syscall(__NR_io_uring_setup, depth, &params);
+        if (fd_ < 0) {
+            return false;
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                        IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            return false;
+        }
+        cq_ring_ = single_mmap ? sq_ring_ : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            return false;
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) {
+            return false;
+        }
+
+        auto sq = (uint8_t *)sq_ring_;
+        sq_head_ = (unsigned *)(sq + params.sq_off.head);
+        sq_tail_ = (unsigned *)(sq + params.sq_off.tail);
+        sq_mask_ = *(unsigned *)(sq + params.sq_off.ring_mask);
+        sq_array_ = (unsigned *)(sq + params.sq_off.array);
+
+        auto cq = (uint8_t *)cq_ring_;
+        cq_head_ = (unsigned *)(cq + params.cq_off.head);
+        cq_tail_ = (unsigned *)(cq + params.cq_off.tail);
+        cq_mask_ = *(unsigned *)(cq + params.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+        // пробное чтение: io_uring_setup может работать, а IORING_OP_READ -- нет (ядра до 5.6)
+        int pipe_fds[2];
+        if (pipe(pipe_fds) != 0) {
+            return false;
+        }
+        uint8_t byte = 0;
+        bool probed = write(pipe_fds[1], &byte, 1) == 1;
+        if (probed) {
+            std::vector<Completion> completions;
+            std::string error;
+            submit({pipe_fds[0], &byte, 1, (uint64_t)-1, 0});
+            probed = wait(completions, error) && completions.size() == 1 && completions[0].result == 1;
+        }
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return probed;
+    }
+
+    const char *name() const override {
+        return "io_uring";
+    }
+
+    void submit(const Request &request) override {
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & sq_mask_;
+        auto &sqe = ((io_uring_sqe *)sqes_)[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = request.fd;
+        sqe.addr = (uint64_t)request.buffer;
+        sqe.len = (uint32_t)request.length;
+        sqe.off = request.offset;
+        sqe.user_data = request.tag;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        to_submit_++;
+    }
+
+    bool wait(std::vector<Completion> &completions, std::string &error) override {
+        auto before = completions.size();
+        while (completions.size() == before) {
+            if (!reap(completions, true, error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+
+    /**
+     * Отправляет накопленные запросы и забирает готовые завершения; с blocking ждёт хотя бы одно.
+     * false -- io_uring_enter вернул ошибку, после которой повторять вызов бессмысленно.
+     */
+    bool reap(std::vector<Completion> &completions, bool blocking, std::string &error) {
+        auto before = completions.size();
+        collect(completions);
+        if (completions.size() > before && to_submit_ == 0) {
+            return true;
+        }
+
+        unsigned flags = blocking && completions.size() == before ? IORING_ENTER_GETEVENTS : 0;
+        STRIBOG_STATS_TIME(io);
+        auto submitted = syscall(__NR_io_uring_enter, fd_, to_submit_, flags ? 1 : 0, flags, nullptr, 0);
+        if (submitted < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                error = std::string("io_uring_enter: ") + strerror(errno);
+                collect(completions);
+                return false;
+            }
+        } else {
+            to_submit_ -= (unsigned)submitted;
+        }
+
+        collect(completions);
+        return true;
+    }
+
+    void collect(std::vector<Completion> &completions) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const auto &cqe = cqes_[head & cq_mask_];
+            completions.push_back({cqe.user_data, cqe.res});
+            head++;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    int fd_ = -1;
+
+    void *sq_ring_ = nullptr;
+    void *cq_ring_ = nullptr;
+    void *sqes_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned *sq_array_ = nullptr;
+
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+
+    unsigned to_submit_ = 0;
+};
+
+class Pread_backend : public Backend {
+public:
+    explicit Pread_backend(unsigned threads) {
+        for (unsigned i = 0; i < std::max(1u, threads); i++) {
+            threads_.emplace_back([this] { work(); });
+        }
+    }
+
+    ~Pread_backend() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        has_requests_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    const char *name() const override {
+        return "pread";
+    }
+
+    void submit(const Request &request) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests_.push_back(request);
+        }
+        has_requests_.notify_one();
+    }
+
+    bool wait(std::vector<Completion> &completions, std::string &) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        has_completions_.wait(lock, [this] { return !completions_.empty(); });
+        completions.insert(completions.end(), completions_.begin(), completions_.end());
+        completions_.clear();
+        return true;
+    }
+
+private:
+
+    void work() {
+        while (true) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                has_requests_.wait(lock, [this] { return stopping_ || !requests_.empty(); });
+                if (requests_.empty()) {
+                    return;
+                }
+                request = requests_.front();
+                requests_.pop_front();
+            }
+
+            ssize_t result;
+            {
+                STRIBOG_STATS_TIME(io);
+                do {
+                    result = pread(request.fd, request.buffer, request.length, (off_t)request.offset);
+                } while (result < 0 && errno == EINTR);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                completions_.push_back({request.tag, result < 0 ? -(int64_t)errno : (int64_t)result});
+            }
+            has_completions_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable has_requests_;
+    std::condition_variable has_completions_;
+    std::deque<Request> requests_;
+    std::vector<Completion> completions_;
+    bool stopping_ = false;
+};
+
+};
+
+std::unique_ptr<Backend> make_uring(unsigned depth) {
+    std::unique_ptr<Uring_backend> backend(new Uring_backend());
+    if (!backend->init(depth)) {
+        return nullptr;
+    }
+    return backend;
+}
+
+std::unique_ptr<Backend> make_pread(unsigned threads) {
+    return std::unique_ptr<Backend>(new Pread_backend(threads));
+}
+
+};
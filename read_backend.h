@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Асинхронное чтение файлов: io_uring, а если он недоступен (старое ядро, seccomp) --
+ * пул потоков, выполняющих pread.
+ */
+namespace read_backend {
+
+struct Request {
+    int fd;
+    uint8_t *buffer;
+    size_t length;
+    uint64_t offset;
+    uint64_t tag;
+};
+
+struct Completion {
+    uint64_t tag;
+    int64_t result;     // число прочитанных байт или -errno
+};
+
+class Backend {
+public:
+    virtual ~Backend() = default;
+
+    virtual const char *name() const = 0;
+
+    /**
+     * Ставит чтение в очередь; число одновременно поставленных запросов не больше depth.
+     */
+    virtual void submit(const Request &request) = 0;
+
+    /**
+     * Дожидается хотя бы одного завершения и дописывает все готовые в completions. false --
+     * очередь сломалась и больше не отдаст завершений: чтения, которых нет в completions, нужно
+     * поставить заново в другую очередь.
+     */
+    virtual bool wait(std::vector<Completion> &completions, std::string &error) = 0;
+};
+
+/**
+ * nullptr, если io_uring в этой системе не работает.
+ */
+std::unique_ptr<Backend> make_uring(unsigned depth);
+
+std::unique_ptr<Backend> make_pread(unsigned threads);
+
+};
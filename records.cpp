@@ -0,0 +1,375 @@
+#include "records.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <immintrin.h>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+#include "hex.h"
+#include "multibuffer.h"
+#include "thread_pool.h"
+
+namespace records {
+
+namespace {
+
+/**
+ * Записей в одном вызове hash_many.
+ */
+const size_t batch_records = 256;
+
+using Find_all = void (*)(const uint8_t *, size_t, uint8_t, std::vector<size_t> &);
+
+void find_tail(const uint8_t *data, size_t begin, size_t length, uint8_t value, std::vector<size_t> &positions) {
+    for (size_t i = begin; i < length; i++) {
+        if (data[i] == value) {
+            positions.push_back(i);
+        }
+    }
+}
+
+void find_sse2(const uint8_t *data, size_t length, uint8_t value, std::vector<size_t> &positions) {
+    auto needle = _mm_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        auto bytes = _mm_loadu_si128((const __m128i *)(data + i));
+        auto mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle));
+        while (mask != 0) {
+            positions.push_back(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    find_tail(data, i, length, value, positions);
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+void find_avx2(const uint8_t *data, size_t length, uint8_t value, std::vector<size_t> &positions) {
+    auto needle = _mm256_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        auto bytes = _mm256_loadu_si256((const __m256i *)(data + i));
+        auto mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle));
+        while (mask != 0) {
+            positions.push_back(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    find_tail(data, i, length, value, positions);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+void find_avx512bw(const uint8_t *data, size_t length, uint8_t value, std::vector<size_t> &positions) {
+    auto needle = _mm512_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        auto bytes = _mm512_loadu_si512((const void *)(data + i));
+        uint64_t mask = _mm512_cmpeq_epi8_mask(bytes, needle);
+        while (mask != 0) {
+            positions.push_back(i + __builtin_ctzll(mask));
+            mask &= mask - 1;
+        }
+    }
+    find_tail(data, i, length, value, positions);
+}
+
+#pragma GCC pop_options
+
+struct Scanner {
+    const char *name;
+    Find_all find_all;
+};
+
+const Scanner &select_scanner() {
+    static const Scanner avx512bw = {"avx512bw", find_avx512bw};
+    static const Scanner avx2 = {"avx2", find_avx2};
+    static const Scanner sse2 = {"sse2", find_sse2};
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        return avx512bw;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return avx2;
+    }
+    return sse2;
+}
+
+const Scanner &scanner() {
+    static const Scanner &selected = select_scanner();
+    return selected;
+}
+
+uint32_t read_length(const uint8_t *data, Format format) {
+    if (format == format_u32le) {
+        return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+    }
+    return (uint32_t)data[3] | (uint32_t)data[2] << 8 | (uint32_t)data[1] << 16 | (uint32_t)data[0] << 24;
+}
+
+struct Segment {
+    size_t begin;
+    size_t end;
+    std::vector<uint8_t> output;
+    uint64_t records;
+};
+
+/**
+ * Обработка одного сегмента; буферы переиспользуются между сегментами одного потока.
+ */
+class Segment_hasher {
+public:
+    explicit Segment_hasher(const Options &options) : options_(options), digest_size_(options.hash_bits / 8) {
+        messages_.reserve(batch_records);
+        lengths_.reserve(batch_records);
+        digests_.resize(batch_records * digest_size_);
+    }
+
+    void run(const uint8_t *data, Segment &segment) {
+        output_ = &segment.output;
+        output_->clear();
+        segment.records = 0;
+
+        if (options_.format == format_lines) {
+            positions_.clear();
+            scanner().find_all(data + segment.begin, segment.end - segment.begin, '\n', positions_);
+            output_->reserve((positions_.size() + 1) * (options_.binary ? digest_size_ : 2 * digest_size_ + 1));
+            auto start = segment.begin;
+            for (auto position : positions_) {
+                add(data + start, segment.begin + position - start);
+                start = segment.begin + position + 1;
+            }
+            if (start < segment.end) {
+                add(data + start, segment.end - start);
+            }
+        } else {
+            for (auto position = segment.begin; position < segment.end;) {
+                auto length = read_length(data + position, options_.format);
+                add(data + position + 4, length);
+                position += 4 + (size_t)length;
+            }
+        }
+        flush();
+        segment.records = records_;
+        records_ = 0;
+    }
+
+private:
+    void add(const uint8_t *record, size_t length) {
+        messages_.push_back(record);
+        lengths_.push_back(length);
+        if (messages_.size() == batch_records) {
+            flush();
+        }
+    }
+
+    void flush() {
+        auto count = messages_.size();
+        if (count == 0) {
+            return;
+        }
+        multibuffer::hash_many(messages_.data(), lengths_.data(), count, digests_.data(), options_.hash_bits);
+        records_ += count;
+        messages_.clear();
+        lengths_.clear();
+
+        if (options_.binary) {
+            output_->insert(output_->end(), digests_.begin(), digests_.begin() + count * digest_size_);
+            return;
+        }
+        auto line_size = 2 * digest_size_ + 1;
+        auto offset = output_->size();
+        output_->resize(offset + count * line_size);
+        auto out = (char *)output_->data() + offset;
+        for (size_t i = 0; i < count; i++) {
+            hex::encode(digests_.data() + i * digest_size_, digest_size_, out);
+            out[2 * digest_size_] = '\n';
+            out += line_size;
+        }
+    }
+
+    const Options &options_;
+    const size_t digest_size_;
+    std::vector<size_t> positions_;
+    std::vector<const uint8_t *> messages_;
+    std::vector<size_t> lengths_;
+    std::vector<uint8_t> digests_;
+    std::vector<uint8_t> *output_ = nullptr;
+    uint64_t records_ = 0;
+};
+
+/**
+ * Конец сегмента, начинающегося с begin: граница записи не раньше begin + segment_size.
+ */
+bool segment_end(const uint8_t *data, size_t length, size_t begin, const Options &options, size_t &end,
+                 std::string &error) {
+    auto target = std::min(length, begin + std::max<size_t>(1, options.segment_size));
+    if (options.format == format_lines) {
+        auto newline = target < length ? (const uint8_t *)memchr(data + target, '\n', length - target) : nullptr;
+        end = newline != nullptr ? (size_t)(newline - data) + 1 : length;
+        return true;
+    }
+
+    end = begin;
+    while (end < target) {
+        if (length - end < 4 || length - end - 4 < read_length(data + end, options.format)) {
+            error = "record at offset " + std::to_string(end) + " is truncated";
+            return false;
+        }
+        end += 4 + (size_t)read_length(data + end, options.format);
+    }
+    return true;
+}
+
+/**
+ * Длина наибольшего начала data из целых записей.
+ */
+size_t complete_records(const uint8_t *data, size_t length, const Options &options) {
+    if (options.format == format_lines) {
+        auto newline = length > 0 ? (const uint8_t *)memrchr(data, '\n', length) : nullptr;
+        return newline != nullptr ? (size_t)(newline - data) + 1 : 0;
+    }
+    size_t end = 0;
+    while (length - end >= 4 && length - end - 4 >= read_length(data + end, options.format)) {
+        end += 4 + (size_t)read_length(data + end, options.format);
+    }
+    return end;
+}
+
+};
+
+void find_all(const uint8_t *data, size_t length, uint8_t value, std::vector<size_t> &positions) {
+    scanner().find_all(data, length, value, positions);
+}
+
+const char *scanner_name() {
+    return scanner().name;
+}
+
+bool hash_records(const uint8_t *data, size_t length, const Options &options, const Sink &sink, Report &report,
+                  std::string &error) {
+    if (options.hash_bits != 256 && options.hash_bits != 512) {
+        error = "digest size must be 256 or 512";
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    auto threads = options.threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.threads;
+    std::vector<Segment_hasher> hashers(threads, Segment_hasher(options));
+
+    // сегменты идут раундами по несколько на поток; вывод раунда выдаётся по порядку
+    std::vector<Segment> segments(threads * 4);
+    std::unique_ptr<Thread_pool> pool;
+    if (threads > 1) {
+        pool.reset(new Thread_pool(threads));
+    }
+    std::mutex idle_mutex;
+    std::vector<Segment_hasher *> idle;
+    for (auto &hasher : hashers) {
+        idle.push_back(&hasher);
+    }
+
+    bool ok = true;
+    size_t position = 0;
+    while (ok && position < length) {
+        size_t count = 0;
+        while (count < segments.size() && position < length) {
+            auto &segment = segments[count];
+            segment.begin = position;
+            if (!segment_end(data, length, position, options, segment.end, error)) {
+                ok = false;
+                break;
+            }
+            position = segment.end;
+            count++;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            auto task = [&, i] {
+                Segment_hasher *hasher;
+                {
+                    std::lock_guard<std::mutex> lock(idle_mutex);
+                    hasher = idle.back();
+                    idle.pop_back();
+                }
+                hasher->run(data, segments[i]);
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                idle.push_back(hasher);
+            };
+            if (pool) {
+                pool->submit(task);
+            } else {
+                task();
+            }
+        }
+        if (pool) {
+            pool->wait();
+        }
+
+        for (size_t i = 0; i < count && ok; i++) {
+            report.records += segments[i].records;
+            report.bytes += segments[i].end - segments[i].begin;
+            if (!sink(segments[i].output.data(), segments[i].output.size())) {
+                error = "write failed";
+                ok = false;
+            }
+        }
+    }
+
+    report.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+bool hash_stream(int fd, const Options &options, const Sink &sink, Report &report, std::string &error) {
+    std::vector<uint8_t> buffer(std::max<size_t>(1, options.window_size));
+    size_t filled = 0;
+    uint64_t base = 0;
+    bool at_end = false;
+    while (!at_end) {
+        while (filled < buffer.size()) {
+            auto count = read(fd, buffer.data() + filled, buffer.size() - filled);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                error = strerror(errno);
+                return false;
+            }
+            if (count == 0) {
+                at_end = true;
+                break;
+            }
+            filled += (size_t)count;
+        }
+        // последняя строка может не иметь '\n', запись с префиксом длины -- нет
+        auto complete = at_end && options.format == format_lines ? filled
+                                                                 : complete_records(buffer.data(), filled, options);
+        if (at_end && complete < filled) {
+            error = "record at offset " + std::to_string(base + complete) + " is truncated";
+            return false;
+        }
+        if (complete > 0 && !hash_records(buffer.data(), complete, options, sink, report, error)) {
+            return false;
+        }
+        memmove(buffer.data(), buffer.data() + complete, filled - complete);
+        filled -= complete;
+        base += complete;
+        if (filled == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+    }
+    return true;
+}
+
+};
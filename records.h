@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Хеширование каждой записи большого файла: строки, разделённые '\n', или записи с 4-байтным
+ * префиксом длины. Вход разбивается на сегменты по границам записей, сегменты обрабатываются
+ * в пуле потоков: границы строк ищутся векторным сравнением (SSE2 / AVX2 / AVX-512BW), записи
+ * хешируются пачками многобуферным движком, дайджесты форматируются в буфер сегмента,
+ * и буферы выдаются по порядку одним вызовом записи каждый.
+ */
+namespace records {
+
+enum Format {
+    format_lines,       // запись -- строка без '\n'; последняя строка может не иметь '\n'
+    format_u32le,       // uint32 little-endian длина, затем данные
+    format_u32be
+};
+
+struct Options {
+    Format format = format_lines;
+    size_t hash_bits = 256;
+    bool binary = false;            // дайджесты подряд вместо "<hex>\n"
+    size_t threads = 0;             // 0 -- по числу процессоров
+    size_t segment_size = 4 << 20;  // примерный объём входа одной задачи
+    size_t window_size = 64 << 20;  // окно чтения hash_stream; растёт под запись длиннее окна
+};
+
+struct Report {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+/**
+ * Получает отформатированный вывод по порядку; false прерывает обработку.
+ */
+using Sink = std::function<bool(const uint8_t *data, size_t length)>;
+
+/**
+ * Добавляет в positions смещения всех байтов value в data.
+ */
+void find_all(const uint8_t *data, size_t length, uint8_t value, std::vector<size_t> &positions);
+
+/**
+ * Имя выбранной реализации find_all ("avx512bw", "avx2", "sse2").
+ */
+const char *scanner_name();
+
+/**
+ * false и описание в error, если запись с префиксом длины выходит за конец данных или sink отказал.
+ */
+bool hash_records(const uint8_t *data, size_t length, const Options &options, const Sink &sink, Report &report,
+                  std::string &error);
+
+/**
+ * То же для канала или стандартного ввода: fd читается окнами по window_size, в hash_records
+ * уходят только целые записи, незаконченная последняя переносится в начало следующего окна.
+ */
+bool hash_stream(int fd, const Options &options, const Sink &sink, Report &report, std::string &error);
+
+};
@@ -0,0 +1,125 @@
+#include "stats.h"
+
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+namespace stats {
+
+namespace {
+
+const char *counter_names[counter_count] = {"blocks_compressed", "bytes_hashed", "allocations"};
+
+const char *stage_names[stage_count] = {"io", "padding", "compress", "key_schedule", "rounds", "finalize"};
+
+#ifdef STRIBOG_STATS
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<Thread_counters *> threads;
+    Snapshot retired;
+};
+
+Registry &registry() {
+    // не разрушается: потоки могут завершаться после статических деструкторов
+    static auto instance = new Registry;
+    return *instance;
+}
+
+void accumulate(Snapshot &total, const Thread_counters &counters) {
+    for (int i = 0; i < counter_count; i++) {
+        total.counters[i] += counters.counters[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < stage_count; i++) {
+        total.stage_ticks[i] += counters.stage_ticks[i].load(std::memory_order_relaxed);
+        total.stage_calls[i] += counters.stage_calls[i].load(std::memory_order_relaxed);
+    }
+    total.threads++;
+}
+
+/**
+ * Счётчики текущего потока для count_allocation; тривиальная инициализация, поэтому безопасно
+ * обращаться к ней из самого operator new, пока Thread_counters ещё не создан.
+ */
+thread_local Thread_counters *current = nullptr;
+
+#endif
+
+};
+
+const char *counter_name(Counter counter) {
+    return counter_names[counter];
+}
+
+const char *stage_name(Stage stage) {
+    return stage_names[stage];
+}
+
+#ifdef STRIBOG_STATS
+
+Thread_counters::Thread_counters() {
+    auto &instance = registry();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    instance.threads.push_back(this);
+    current = this;
+}
+
+Thread_counters::~Thread_counters() {
+    current = nullptr;
+    auto &instance = registry();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    accumulate(instance.retired, *this);
+    for (size_t i = 0; i < instance.threads.size(); i++) {
+        if (instance.threads[i] == this) {
+            instance.threads.erase(instance.threads.begin() + (long)i);
+            break;
+        }
+    }
+}
+
+void count_allocation() {
+    if (current != nullptr) {
+        Thread_counters::increment(current->counters[allocations], 1);
+    }
+}
+
+Snapshot snapshot() {
+    auto &instance = registry();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    auto result = instance.retired;
+    for (auto counters : instance.threads) {
+        accumulate(result, *counters);
+    }
+    return result;
+}
+
+#else
+
+Snapshot snapshot() {
+    return {};
+}
+
+#endif
+
+void print(const Snapshot &snapshot, std::ostream &out) {
+    if (!enabled) {
+        out << "stats: not collected, rebuild with -DSTRIBOG_STATS=ON" << std::endl;
+        return;
+    }
+
+    out << "stats (" << snapshot.threads << " threads):" << std::endl;
+    for (int i = 0; i < counter_count; i++) {
+        out << "  " << std::left << std::setw(18) << counter_names[i] << std::right << std::setw(16)
+            << snapshot.counters[i] << std::endl;
+    }
+    out << "  " << std::left << std::setw(18) << "stage" << std::right << std::setw(16) << "tsc ticks"
+        << std::setw(14) << "calls" << std::setw(14) << "ticks/call" << std::endl;
+    for (int i = 0; i < stage_count; i++) {
+        auto calls = snapshot.stage_calls[i];
+        out << "  " << std::left << std::setw(18) << stage_names[i] << std::right << std::setw(16)
+            << snapshot.stage_ticks[i] << std::setw(14) << calls << std::setw(14)
+            << (calls == 0 ? 0 : snapshot.stage_ticks[i] / calls) << std::endl;
+    }
+}
+
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include "perf_counters.h"
+
+/**
+ * Инструментирование горячего пути: счётчики блоков, байт и выделений памяти и время (такты TSC)
+ * по стадиям -- ввод-вывод, дополнение, сжатие, ключевое расписание и раунды E, финализация.
+ *
+ * Включается при сборке с STRIBOG_STATS (cmake -DSTRIBOG_STATS=ON). Без него макросы
+ * STRIBOG_STATS_ADD и STRIBOG_STATS_TIME пустые и в код не попадают, а snapshot() возвращает нули.
+ *
+ * Каждый поток пишет только в свои счётчики (без атомарных read-modify-write), snapshot()
+ * складывает живые потоки и уже завершившиеся. Стадии вложены: compress включает key_schedule
+ * и rounds, finalize -- padding и три последних сжатия.
+ *
+ * Библиотека не подменяет глобальный operator new: выделения считает только утилита Stribog
+ * (stats_new.cpp), прочие приложения видят в этом счётчике ноль.
+ */
+namespace stats {
+
+#ifdef STRIBOG_STATS
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+enum Counter {
+    blocks_compressed,
+    bytes_hashed,
+    allocations,
+    counter_count
+};
+
+enum Stage {
+    io,
+    padding,
+    compress,
+    key_schedule,
+    rounds,
+    finalize,
+    stage_count
+};
+
+const char *counter_name(Counter counter);
+
+const char *stage_name(Stage stage);
+
+struct Snapshot {
+    uint64_t counters[counter_count] = {};
+    uint64_t stage_ticks[stage_count] = {};
+    uint64_t stage_calls[stage_count] = {};
+    size_t threads = 0;
+};
+
+/**
+ * Сумма по всем потокам, включая завершившиеся.
+ */
+Snapshot snapshot();
+
+/**
+ * Таблица для --stats; без STRIBOG_STATS -- одна строка о том, что статистика не собрана.
+ */
+void print(const Snapshot &snapshot, std::ostream &out);
+
+#ifdef STRIBOG_STATS
+
+struct Thread_counters {
+    std::atomic<uint64_t> counters[counter_count] = {};
+    std::atomic<uint64_t> stage_ticks[stage_count] = {};
+    std::atomic<uint64_t> stage_calls[stage_count] = {};
+
+    Thread_counters();
+    ~Thread_counters();
+
+    static void increment(std::atomic<uint64_t> &value, uint64_t term) {
+        value.store(value.load(std::memory_order_relaxed) + term, std::memory_order_relaxed);
+    }
+};
+
+inline Thread_counters &local() {
+    static thread_local Thread_counters counters;
+    return counters;
+}
+
+/**
+ * Учитывает выделение памяти в счётчиках текущего потока, если они уже созданы; безопасно
+ * вызывать из operator new.
+ */
+void count_allocation();
+
+inline void add(Counter counter, uint64_t value) {
+    Thread_counters::increment(local().counters[counter], value);
+}
+
+class Stage_timer {
+public:
+    explicit Stage_timer(Stage stage) : stage_(stage), begin_(perf::read_tsc()) {
+    }
+
+    Stage_timer(const Stage_timer &) = delete;
+    Stage_timer &operator=(const Stage_timer &) = delete;
+
+    ~Stage_timer() {
+        auto &counters = local();
+        Thread_counters::increment(counters.stage_ticks[stage_], perf::read_tsc() - begin_);
+        Thread_counters::increment(counters.stage_calls[stage_], 1);
+    }
+
+private:
+    Stage stage_;
+    uint64_t begin_;
+};
+
+#define STRIBOG_STATS_CONCAT_(a, b) a##b
+#define STRIBOG_STATS_CONCAT(a, b) STRIBOG_STATS_CONCAT_(a, b)
+#define STRIBOG_STATS_ADD(counter, value) ::stats::add(::stats::counter, (value))
+#define STRIBOG_STATS_TIME(stage) ::stats::Stage_timer STRIBOG_STATS_CONCAT(stats_timer_, __LINE__)(::stats::stage)
+
+#else
+
+#define STRIBOG_STATS_ADD(counter, value) ((void)0)
+#define STRIBOG_STATS_TIME(stage) ((void)0)
+
+#endif
+
+};
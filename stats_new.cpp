@@ -0,0 +1,40 @@
+#include "stats.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef STRIBOG_STATS
+
+/**
+ * Подсчёт выделений памяти: глобальные operator new / delete заменяются только в утилите Stribog
+ * со статистикой, библиотека stribog аллокатор приложения не трогает.
+ */
+void *operator new(size_t size) {
+    stats::count_allocation();
+    if (auto pointer = malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    free(pointer);
+}
+
+#endif
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+
+#include "compression.h"
+#include "kernels.h"
+#include "stats.h"
+
+/**
+ * Потоковый контекст хеширования: init / update / final над сырыми байтами.
+ *
+ * Сообщение -- последовательность байт, которая трактуется как 512-битные числа в little-endian
+ * (первый байт -- младший), поэтому блоки сжимаются в порядке поступления. Между вызовами update
+ * хранятся только h, N, Sigma и не более одного неполного 64-байтного блока; полные блоки
+ * читаются прямо из входного буфера без копирования.
+ *
+ * Стандартный IV и усечение результата определяются параметром шаблона: Streebog<512> и Streebog<256>.
+ */
+template<size_t hash_bits>
+class Streebog {
+    static_assert(hash_bits == 256 || hash_bits == 512, "Streebog is defined for 256 and 512 bit digests");
+
+public:
+    static constexpr size_t block_size = 64;
+    static constexpr size_t digest_size = hash_bits / 8;
+
+    using digest_t = std::array<uint8_t, digest_size>;
+
+    static constexpr compression::state_t IV = {
+            hash_bits == 256 ? 0x0101010101010101ULL : 0, hash_bits == 256 ? 0x0101010101010101ULL : 0,
+            hash_bits == 256 ? 0x0101010101010101ULL : 0, hash_bits == 256 ? 0x0101010101010101ULL : 0,
+            hash_bits == 256 ? 0x0101010101010101ULL : 0, hash_bits == 256 ? 0x0101010101010101ULL : 0,
+            hash_bits == 256 ? 0x0101010101010101ULL : 0, hash_bits == 256 ? 0x0101010101010101ULL : 0};
+
+    Streebog() {
+        init();
+    }
+
+    static void hash(const uint8_t *data, size_t length, uint8_t *out) {
+        Streebog context;
+        context.update(data, length);
+        context.final(out);
+    }
+
+    static digest_t hash(const uint8_t *data, size_t length) {
+        digest_t result;
+        hash(data, length, result.data());
+        return result;
+    }
+
+    /**
+     * Вход длины input_size <= 64, известной при компиляции: цепочки хешей, хеш от хеша.
+     * Дополнение, N и ключ первого сжатия LPS(IV) свёрнуты в константы, контекст и буфер не нужны.
+     * Сжатий три при input_size < 64 и четыре ровно при 64 байтах: по стандарту за полным блоком
+     * следует блок дополнения 0...01.
+     */
+    template<size_t input_size>
+    static void hash(const std::array<uint8_t, input_size> &data, digest_t &out) {
+        static_assert(input_size <= block_size, "fixed-size path covers a single block");
+
+        const compression::state_t zero = {};
+        compression::state_t m = {};
+        memcpy(m.data(), data.data(), input_size);
+        if constexpr (input_size < block_size) {
+            m[input_size / 8] |= 1ULL << (8 * (input_size % 8));
+        }
+
+        // g_0(IV, m) с ключом, вычисленным при компиляции
+        auto h = compression::e_function(IV_key, m);
+        for (int i = 0; i < 8; i++) {
+            h[i] ^= IV[i] ^ m[i];
+        }
+
+        if constexpr (input_size == block_size) {
+            constexpr compression::state_t padding = {1};
+            constexpr compression::state_t N = {512};
+            h = kernels::g_function(h, padding, N);
+            compression::add(m, 1);
+            h = kernels::g_function(h, N, zero);
+        } else {
+            constexpr compression::state_t N = {input_size * 8};
+            h = kernels::g_function(h, N, zero);
+        }
+        // m теперь Sigma
+        h = kernels::g_function(h, m, zero);
+
+        STRIBOG_STATS_ADD(bytes_hashed, input_size);
+        STRIBOG_STATS_ADD(blocks_compressed, input_size == block_size ? 4 : 3);
+        memcpy(out.data(), h.data() + 8 - digest_size / 8, digest_size);
+    }
+
+    template<size_t input_size>
+    static digest_t hash(const std::array<uint8_t, input_size> &data) {
+        digest_t result;
+        hash(data, result);
+        return result;
+    }
+
+    void init() {
+        h_ = IV;
+        N_.fill(0);
+        Sigma_.fill(0);
+        buffered_ = 0;
+    }
+
+    void update(const uint8_t *data, size_t length) {
+        STRIBOG_STATS_ADD(bytes_hashed, length);
+        if (buffered_ > 0) {
+            auto need = std::min(block_size - buffered_, length);
+            memcpy(buffer_ + buffered_, data, need);
+            buffered_ += need;
+            data += need;
+            length -= need;
+            if (buffered_ < block_size) {
+                return;
+            }
+            compress_block(buffer_);
+            buffered_ = 0;
+        }
+
+        while (length >= block_size) {
+            compress_block(data);
+            data += block_size;
+            length -= block_size;
+        }
+
+        if (length > 0) {
+            memcpy(buffer_, data, length);
+            buffered_ = length;
+        }
+    }
+
+    /**
+     * Записывает digest_size байт результата в out (младший байт первым).
+     * После вызова контекст нужно заново проинициализировать через init().
+     */
+    void final(uint8_t *out) {
+        STRIBOG_STATS_TIME(finalize);
+        {
+            STRIBOG_STATS_TIME(padding);
+            memset(buffer_ + buffered_, 0, block_size - buffered_);
+            buffer_[buffered_] = 0x01;
+        }
+        STRIBOG_STATS_ADD(blocks_compressed, 3);
+
+        auto m = load_block(buffer_);
+        h_ = kernels::g_function(h_, m, N_);
+        compression::add(N_, buffered_ * 8);
+        compression::add(Sigma_, m);
+
+        const compression::state_t zero = {};
+        h_ = kernels::g_function(h_, N_, zero);
+        h_ = kernels::g_function(h_, Sigma_, zero);
+
+        // для 256 бит берутся старшие четыре слова
+        memcpy(out, h_.data() + 8 - digest_size / 8, digest_size);
+    }
+
+    digest_t final() {
+        digest_t result;
+        final(result.data());
+        return result;
+    }
+
+    /**
+     * Сколько байт сообщения уже поглощено -- с этого смещения продолжается хеширование
+     * после load_checkpoint.
+     */
+    uint64_t bytes_hashed() const {
+        return N_[0] / 8 + buffered_;
+    }
+
+    /**
+     * Снимок состояния (h, N, Sigma и неполный блок) для возобновления хеширования или повторного
+     * использования общего префикса. Формат, все числа в little-endian:
+     *
+     *     "SBG" | версия (1) | hash_bits / 64 | buffered | h (64) | Sigma (64) | N mod 2^64 (8) |
+     *     буфер (buffered байт) | первые 8 байт Streebog-256 от всего предыдущего
+     *
+     * Копия контекста -- тоже снимок, но только внутри процесса.
+     */
+    static constexpr uint8_t checkpoint_version = 1;
+    static constexpr size_t checkpoint_header_size = 6;
+    static constexpr size_t checkpoint_checksum_size = 8;
+    static constexpr size_t max_checkpoint_size = checkpoint_header_size + 64 + 64 + 8 + block_size +
+                                                  checkpoint_checksum_size;
+
+    size_t checkpoint_size() const {
+        return max_checkpoint_size - block_size + buffered_;
+    }
+
+    /**
+     * Записывает снимок в out (не больше max_checkpoint_size байт) и возвращает его размер;
+     * 0, если сообщение длиннее 2^64 бит и в компактный формат не помещается.
+     */
+    size_t save_checkpoint(uint8_t *out) const {
+        for (int i = 1; i < 8; i++) {
+            if (N_[i] != 0) {
+                return 0;
+            }
+        }
+
+        auto position = out;
+        memcpy(position, "SBG", 3);
+        position[3] = checkpoint_version;
+        position[4] = (uint8_t)(hash_bits / 64);
+        position[5] = (uint8_t)buffered_;
+        position += checkpoint_header_size;
+        memcpy(position, h_.data(), 64);
+        position += 64;
+        memcpy(position, Sigma_.data(), 64);
+        position += 64;
+        memcpy(position, N_.data(), 8);
+        position += 8;
+        memcpy(position, buffer_, buffered_);
+        position += buffered_;
+
+        auto checksum = Streebog<256>::hash(out, (size_t)(position - out));
+        memcpy(position, checksum.data(), checkpoint_checksum_size);
+        position += checkpoint_checksum_size;
+        return (size_t)(position - out);
+    }
+
+    /**
+     * Восстанавливает контекст из снимка; при неверном формате, версии, размере дайджеста
+     * или контрольной сумме возвращает false и не меняет контекст.
+     */
+    bool load_checkpoint(const uint8_t *data, size_t length) {
+        if (length < checkpoint_header_size || memcmp(data, "SBG", 3) != 0 || data[3] != checkpoint_version ||
+            data[4] != hash_bits / 64 || data[5] >= block_size ||
+            length != max_checkpoint_size - block_size + data[5]) {
+            return false;
+        }
+        auto body_length = length - checkpoint_checksum_size;
+        auto checksum = Streebog<256>::hash(data, body_length);
+        if (memcmp(checksum.data(), data + body_length, checkpoint_checksum_size) != 0) {
+            return false;
+        }
+
+        buffered_ = data[5];
+        auto position = data + checkpoint_header_size;
+        memcpy(h_.data(), position, 64);
+        position += 64;
+        memcpy(Sigma_.data(), position, 64);
+        position += 64;
+        N_.fill(0);
+        memcpy(N_.data(), position, 8);
+        position += 8;
+        memcpy(buffer_, position, buffered_);
+        return true;
+    }
+
+private:
+
+    static compression::state_t load_block(const uint8_t *data) {
+        compression::state_t result;
+        memcpy(result.data(), data, block_size);
+        return result;
+    }
+
+    void compress_block(const uint8_t *data) {
+        STRIBOG_STATS_TIME(compress);
+        STRIBOG_STATS_ADD(blocks_compressed, 1);
+        auto m = load_block(data);
+        h_ = kernels::g_function(h_, m, N_);
+        compression::add(N_, 512);
+        compression::add(Sigma_, m);
+    }
+
+    static constexpr compression::state_t IV_key = compression::lps(IV);
+
+    compression::state_t h_;
+    compression::state_t N_;
+    compression::state_t Sigma_;
+
+    uint8_t buffer_[block_size];
+    size_t buffered_;
+};
+
+using Streebog_256 = Streebog<256>;
+using Streebog_512 = Streebog<512>;
+
+/**
+ * Streebog-256 и Streebog-512 одного сообщения за один проход: каждый блок читается один раз
+ * и сжимается в обеих цепочках парным ядром kernels::g_pair. N, Sigma и неполный блок у цепочек
+ * общие -- они зависят только от сообщения, различаются лишь IV и h.
+ *
+ * Результат: 32 байта Streebog-256, затем 64 байта Streebog-512 (digest_size = 96).
+ */
+class Streebog_pair {
+public:
+    static constexpr size_t block_size = 64;
+    static constexpr size_t digest_size = Streebog_256::digest_size + Streebog_512::digest_size;
+
+    Streebog_pair() {
+        init();
+    }
+
+    static void hash(const uint8_t *data, size_t length, uint8_t *out) {
+        Streebog_pair context;
+        context.update(data, length);
+        context.final(out);
+    }
+
+    static void hash(const uint8_t *data, size_t length, uint8_t *out256, uint8_t *out512) {
+        Streebog_pair context;
+        context.update(data, length);
+        context.final(out256, out512);
+    }
+
+    void init() {
+        h256_ = Streebog_256::IV;
+        h512_ = Streebog_512::IV;
+        N_.fill(0);
+        Sigma_.fill(0);
+        buffered_ = 0;
+    }
+
+    void update(const uint8_t *data, size_t length) {
+        STRIBOG_STATS_ADD(bytes_hashed, length);
+        if (buffered_ > 0) {
+            auto need = std::min(block_size - buffered_, length);
+            memcpy(buffer_ + buffered_, data, need);
+            buffered_ += need;
+            data += need;
+            length -= need;
+            if (buffered_ < block_size) {
+                return;
+            }
+            compress_block(buffer_);
+            buffered_ = 0;
+        }
+
+        while (length >= block_size) {
+            compress_block(data);
+            data += block_size;
+            length -= block_size;
+        }
+
+        if (length > 0) {
+            memcpy(buffer_, data, length);
+            buffered_ = length;
+        }
+    }
+
+    /**
+     * После вызова контекст нужно заново проинициализировать через init().
+     */
+    void final(uint8_t *out256, uint8_t *out512) {
+        STRIBOG_STATS_TIME(finalize);
+        memset(buffer_ + buffered_, 0, block_size - buffered_);
+        buffer_[buffered_] = 0x01;
+        STRIBOG_STATS_ADD(blocks_compressed, 6);
+
+        compression::state_t m;
+        memcpy(m.data(), buffer_, block_size);
+        kernels::g_pair(h256_, h512_, m, N_);
+        compression::add(N_, buffered_ * 8);
+        compression::add(Sigma_, m);
+
+        const compression::state_t zero = {};
+        kernels::g_pair(h256_, h512_, N_, zero);
+        kernels::g_pair(h256_, h512_, Sigma_, zero);
+
+        memcpy(out256, h256_.data() + 4, Streebog_256::digest_size);
+        memcpy(out512, h512_.data(), Streebog_512::digest_size);
+    }
+
+    void final(uint8_t *out) {
+        final(out, out + Streebog_256::digest_size);
+    }
+
+private:
+
+    void compress_block(const uint8_t *data) {
+        STRIBOG_STATS_TIME(compress);
+        STRIBOG_STATS_ADD(blocks_compressed, 2);
+        compression::state_t m;
+        memcpy(m.data(), data, block_size);
+        kernels::g_pair(h256_, h512_, m, N_);
+        compression::add(N_, 512);
+        compression::add(Sigma_, m);
+    }
+
+    compression::state_t h256_;
+    compression::state_t h512_;
+    compression::state_t N_;
+    compression::state_t Sigma_;
+
+    uint8_t buffer_[block_size];
+    size_t buffered_;
+};
@@ -0,0 +1,193 @@
+#include "streebog_c.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "kernels.h"
+#include "multibuffer.h"
+#include "streebog.h"
+#include "thread_pool.h"
+
+struct streebog_ctx {
+    unsigned hash_bits;
+    Streebog_256 context_256;
+    Streebog_512 context_512;
+};
+
+namespace {
+
+/**
+ * Пакет делится между потоками, только если на каждый приходится хотя бы столько байт:
+ * меньшие части не окупают передачу задачи в пул.
+ */
+const size_t min_slice_bytes = 256 * 1024;
+
+Thread_pool &shared_pool() {
+    static Thread_pool pool;
+    return pool;
+}
+
+/**
+ * Ожидание завершения своих частей пакета: общий пул могут одновременно использовать
+ * несколько вызывающих потоков, поэтому Thread_pool::wait здесь не подходит.
+ */
+class Latch {
+public:
+    explicit Latch(size_t count) : count_(count) {
+    }
+
+    void count_down() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--count_ == 0) {
+            done_.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return count_ == 0; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    size_t count_;
+};
+
+};
+
+extern "C" {
+
+int streebog_abi_version(void) {
+    return STREEBOG_ABI_VERSION;
+}
+
+const char *streebog_backend(void) {
+    return kernels::active().name;
+}
+
+streebog_ctx *streebog_new(unsigned hash_bits) {
+    if (hash_bits != 256 && hash_bits != 512) {
+        return nullptr;
+    }
+    try {
+        auto ctx = new(std::nothrow) streebog_ctx;
+        if (ctx != nullptr) {
+            ctx->hash_bits = hash_bits;
+        }
+        return ctx;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void streebog_free(streebog_ctx *ctx) {
+    delete ctx;
+}
+
+void streebog_init(streebog_ctx *ctx) {
+    if (ctx->hash_bits == 256) {
+        ctx->context_256.init();
+    } else {
+        ctx->context_512.init();
+    }
+}
+
+void streebog_update(streebog_ctx *ctx, const void *data, size_t length) {
+    if (ctx->hash_bits == 256) {
+        ctx->context_256.update((const uint8_t *)data, length);
+    } else {
+        ctx->context_512.update((const uint8_t *)data, length);
+    }
+}
+
+void streebog_final(streebog_ctx *ctx, uint8_t *out) {
+    if (ctx->hash_bits == 256) {
+        ctx->context_256.final(out);
+    } else {
+        ctx->context_512.final(out);
+    }
+    streebog_init(ctx);
+}
+
+int streebog_hash(unsigned hash_bits, const void *data, size_t length, uint8_t *out) {
+    if (hash_bits == 256) {
+        Streebog_256::hash((const uint8_t *)data, length, out);
+    } else if (hash_bits == 512) {
+        Streebog_512::hash((const uint8_t *)data, length, out);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void streebog_hash_many(const uint8_t *const *msgs, const size_t *lens, size_t n, uint8_t *out) {
+    try {
+        multibuffer::hash_many(msgs, lens, n, out, 512);
+    } catch (...) {
+        // ошибку вернуть некуда: сообщения хешируются по одному, без выделения памяти
+        for (size_t i = 0; i < n; i++) {
+            Streebog_512::hash(msgs[i], lens[i], out + 64 * i);
+        }
+    }
+}
+
+int streebog_hash_many_ex(unsigned hash_bits, const uint8_t *const *msgs, const size_t *lens, size_t n,
+                          uint8_t *out, unsigned threads) {
+    if (hash_bits != 256 && hash_bits != 512) {
+        return -1;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        total += lens[i];
+    }
+    size_t slices = threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    slices = std::min({slices, std::max<size_t>(1, total / min_slice_bytes), std::max<size_t>(1, n)});
+
+    // исключения не должны пересекать границу C: пул создаётся здесь, а не внутри цикла
+    Thread_pool *pool = nullptr;
+    try {
+        if (slices == 1) {
+            multibuffer::hash_many(msgs, lens, n, out, hash_bits);
+            return 0;
+        }
+        pool = &shared_pool();
+    } catch (...) {
+        return -1;
+    }
+    // больше частей, чем потоков пула и вызывающего, всё равно не хешировались бы одновременно
+    slices = std::min(slices, pool->size() + 1);
+
+    // части примерно равны по числу байт; последнюю хеширует вызывающий поток
+    const size_t digest_size = hash_bits / 8;
+    Latch latch(slices - 1);
+    size_t begin = 0;
+    size_t done_bytes = 0;
+    for (size_t slice = 0; slice + 1 < slices; slice++) {
+        auto target = total / slices * (slice + 1);
+        auto end = begin;
+        while (end < n && (end == begin || done_bytes < target)) {
+            done_bytes += lens[end++];
+        }
+        auto hash_slice = [=, &latch] {
+            multibuffer::hash_many(msgs + begin, lens + begin, end - begin, out + begin * digest_size, hash_bits);
+            latch.count_down();
+        };
+        try {
+            pool->submit(hash_slice);
+        } catch (...) {
+            // уже отправленные части ссылаются на latch, поэтому выйти с ошибкой нельзя
+            hash_slice();
+        }
+        begin = end;
+    }
+    multibuffer::hash_many(msgs + begin, lens + begin, n - begin, out + begin * digest_size, hash_bits);
+    latch.wait();
+    return 0;
+}
+
+}
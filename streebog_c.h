@@ -0,0 +1,68 @@
+#ifndef STREEBOG_C_H
+#define STREEBOG_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C ABI библиотеки stribog: ГОСТ Р 34.11-2012 (Streebog).
+ *
+ * Раскладка и смысл функций не меняются в пределах STREEBOG_ABI_VERSION; контекст непрозрачен
+ * и создаётся только через streebog_new. Дайджесты записываются байтами в порядке вывода
+ * (как печатает утилита Stribog), hash_bits -- 256 или 512. Исключения C++ из функций не выходят:
+ * нехватка памяти или потоков сообщается кодом возврата, как описано у каждой функции.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREEBOG_ABI_VERSION 1
+
+typedef struct streebog_ctx streebog_ctx;
+
+/* STREEBOG_ABI_VERSION, с которой собрана библиотека. */
+int streebog_abi_version(void);
+
+/* Имя выбранного ядра g_N ("avx512", "scalar", ...). */
+const char *streebog_backend(void);
+
+/* NULL, если hash_bits не 256 и не 512 или не хватило памяти. */
+streebog_ctx *streebog_new(unsigned hash_bits);
+
+void streebog_free(streebog_ctx *ctx);
+
+void streebog_init(streebog_ctx *ctx);
+
+void streebog_update(streebog_ctx *ctx, const void *data, size_t length);
+
+/* Записывает hash_bits / 8 байт; после вызова контекст снова готов к streebog_update. */
+void streebog_final(streebog_ctx *ctx, uint8_t *out);
+
+/* 0 при успехе, -1 при неверном hash_bits. */
+int streebog_hash(unsigned hash_bits, const void *data, size_t length, uint8_t *out);
+
+/*
+ * Хеширует n независимых сообщений (512 бит), результат i-го -- out + 64 * i.
+ * Выбор ядра и многобуферного движка выполняется один раз на процесс; если многобуферный путь
+ * не удался, сообщения хешируются по одному, так что вызов всегда заполняет out.
+ */
+void streebog_hash_many(const uint8_t *const *msgs, const size_t *lens, size_t n, uint8_t *out);
+
+/*
+ * То же с выбором размера дайджеста и числа потоков: threads -- наибольшее число потоков,
+ * одновременно хеширующих этот вызов, включая вызывающий (1 -- только он, 0 -- по числу
+ * процессоров). Большие пакеты делятся не больше чем на threads непрерывных частей, и все,
+ * кроме одной, хешируются в общем пуле потоков библиотеки, который создаётся при первом
+ * использовании. Размер пула (по числу процессоров) threads не меняет: одновременные вызовы
+ * делят его потоки. 0 при успехе, -1 при неверном hash_bits или если пул не удалось создать
+ * (out тогда не заполнен); часть, которую не удалось отдать в пул, хешируется вызывающим потоком.
+ */
+int streebog_hash_many_ex(unsigned hash_bits, const uint8_t *const *msgs, const size_t *lens, size_t n,
+                          uint8_t *out, unsigned threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,724 @@
+#include "sum_tool.h"
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "digest_cache.h"
+#include "dir_hasher.h"
+#include "file_hash.h"
+#include "hex.h"
+#include "records.h"
+#include "stats.h"
+#include "streebog.h"
+#include "thread_pool.h"
+#include "tree_mode.h"
+#include "utils.h"
+
+namespace sum_tool {
+
+namespace {
+
+struct Options {
+    size_t hash_bits = 256;
+    size_t threads = 0;
+    bool check = false;
+    bool quiet = false;
+    bool recursive = false;
+    bool report = false;
+    bool stats = false;
+    dir_hasher::Options tree;
+    bool merkle = false;
+    size_t leaf_size = 1 << 20;
+    std::string leaves_path;
+    std::string verify_leaves_path;
+    uint64_t range_offset = 0;
+    uint64_t range_length = UINT64_MAX;
+    bool records = false;
+    records::Options record_options;
+    std::string cache_path;
+    digest_cache::Policy cache_policy;
+    bool compact_cache = false;
+    std::vector<std::string> paths;
+};
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [-a 256|512|both] [-j THREADS] [FILE]..." << std::endl
+              << "       " << program << " -c [-q] [-j THREADS] [MANIFEST]..." << std::endl
+              << "       " << program << " -r [--report] [TREE OPTIONS] [DIR]..." << std::endl
+              << "       " << program << " [-r] --cache FILE [--trust-cache | --verify-sample=N%] [FILE|DIR]..."
+              << std::endl
+              << "       " << program << " --tree [--leaf-size N] [--leaves OUT] [FILE]..." << std::endl
+              << "       " << program << " --tree --verify-leaves LEAVES [--range OFFSET:LENGTH] FILE" << std::endl
+              << "       " << program << " --records lines|u32le|u32be [--binary] [-a BITS] [-j THREADS] [FILE]..."
+              << std::endl
+              << "       " << program << " --daemon SOCKET | --load SOCKET [OPTIONS]  (see --daemon --help)" << std::endl
+              << "       " << program << " --ingest STORE [OPTIONS] [PATH]...  (see --ingest --help)" << std::endl
+              << "       " << program << " --self-test" << std::endl
+              << std::endl
+              << "Print or check GOST R 34.11-2012 (Streebog) digests. With no FILE, or when FILE is -," << std::endl
+              << "read standard input. Digests are printed as bytes in output order, one line per file:" << std::endl
+              << "\"<digest>  <file>\". In check mode the digest length selects 256 or 512 bits per line." << std::endl
+              << std::endl
+              << "  -a BITS     digest size, 256 (default) or 512; \"both\" reads each FILE once and prints" << std::endl
+              << "              a 256-bit and a 512-bit line for it (plain digest mode only)" << std::endl
+              << "  -c          read digests from MANIFEST files and check them" << std::endl
+              << "  -q          in check mode, do not print OK for each verified file" << std::endl
+              << "  -j THREADS  number of worker threads (default: number of CPUs)" << std::endl
+              << "  --stats     print per-stage counters and TSC time to stderr (builds with STRIBOG_STATS)"
+              << std::endl
+              << std::endl
+              << "  -r               hash every regular file under each DIR (sorted, output in walk order)" << std::endl
+              << "  --report         print throughput and per-stage queue depths to stderr" << std::endl
+              << "  --max-open N     files read concurrently (default 32; use 1-2 for spinning disks)" << std::endl
+              << "  --buffers N      read buffers in flight (default 64)" << std::endl
+              << "  --chunk-size N   bytes per read (default 1048576)" << std::endl
+              << "  --no-uring       use pread threads instead of io_uring" << std::endl
+              << std::endl
+              << "  --cache FILE     keep digests in FILE keyed by device, inode, size, mtime and ctime; without" << std::endl
+              << "                   a policy every file is still read and cached digests are only compared" << std::endl
+              << "  --trust-cache    print cached digests of unchanged files without reading them" << std::endl
+              << "  --verify-sample=N%" << std::endl
+              << "                   like --trust-cache, but rehash about N% of the cached files and compare" << std::endl
+              << "  --compact-cache  after the run, drop cache entries for files this run did not see" << std::endl
+              << std::endl
+              << "  --tree           NON-STANDARD Merkle tree mode: hash fixed-size leaves in parallel and" << std::endl
+              << "                   combine them into a root; the result differs from the plain digest" << std::endl
+              << "  --leaf-size N    leaf size in bytes (default 1048576), part of the result" << std::endl
+              << "  --leaves OUT     also write \"<index> <offset> <length> <digest>\" leaf lines to OUT" << std::endl
+              << "  --verify-leaves LEAVES" << std::endl
+              << "                   rehash only leaves overlapping --range and report the changed ones" << std::endl
+              << std::endl
+              << "  --records FORMAT print one digest per record of each FILE, in order: lines split at \\n (the" << std::endl
+              << "                   last line may lack it), u32le / u32be -- 4-byte length prefix, then data" << std::endl
+              << "  --binary         with --records, write raw digests instead of hex lines" << std::endl;
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+    bool only_paths = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (only_paths || arg == "-" || arg[0] != '-') {
+            options.paths.push_back(arg);
+        } else if (arg == "--") {
+            only_paths = true;
+        } else if (arg == "-c" || arg == "--check") {
+            options.check = true;
+        } else if (arg == "-q" || arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "-r" || arg == "--recursive") {
+            options.recursive = true;
+        } else if (arg == "--report") {
+            options.report = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--records" && i + 1 < argc) {
+            std::string format = argv[++i];
+            options.records = true;
+            if (format == "lines") {
+                options.record_options.format = records::format_lines;
+            } else if (format == "u32le") {
+                options.record_options.format = records::format_u32le;
+            } else if (format == "u32be") {
+                options.record_options.format = records::format_u32be;
+            } else {
+                std::cerr << argv[0] << ": unknown record format " << format << std::endl;
+                return false;
+            }
+        } else if (arg == "--binary") {
+            options.record_options.binary = true;
+        } else if (arg == "--tree") {
+            options.merkle = true;
+        } else if ((arg == "--leaves" || arg == "--verify-leaves") && i + 1 < argc) {
+            (arg == "--leaves" ? options.leaves_path : options.verify_leaves_path) = argv[++i];
+        } else if (arg == "--leaf-size" && i + 1 < argc) {
+            options.leaf_size = strtoul(argv[++i], nullptr, 10);
+            if (options.leaf_size == 0) {
+                std::cerr << argv[0] << ": --leaf-size must be positive" << std::endl;
+                return false;
+            }
+        } else if (arg == "--range" && i + 1 < argc) {
+            char *end;
+            options.range_offset = strtoull(argv[++i], &end, 10);
+            if (*end != ':') {
+                std::cerr << argv[0] << ": --range expects OFFSET:LENGTH" << std::endl;
+                return false;
+            }
+            options.range_length = strtoull(end + 1, nullptr, 10);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            options.cache_path = argv[++i];
+        } else if (arg == "--trust-cache") {
+            options.cache_policy.trust = true;
+        } else if (arg.compare(0, 16, "--verify-sample=") == 0) {
+            char *end;
+            auto percent = strtod(arg.c_str() + 16, &end);
+            if (end == arg.c_str() + 16 || (*end != '\0' && strcmp(end, "%") != 0) || !(percent >= 0 && percent <= 100)) {
+                std::cerr << argv[0] << ": --verify-sample expects a percentage from 0 to 100" << std::endl;
+                return false;
+            }
+            options.cache_policy.trust = true;
+            options.cache_policy.verify_fraction = percent / 100;
+        } else if (arg == "--compact-cache") {
+            options.compact_cache = true;
+        } else if (arg == "--no-uring") {
+            options.tree.use_uring = false;
+        } else if ((arg == "--max-open" || arg == "--buffers" || arg == "--chunk-size") && i + 1 < argc) {
+            auto value = strtoul(argv[++i], nullptr, 10);
+            if (value == 0) {
+                std::cerr << argv[0] << ": " << arg << " must be positive" << std::endl;
+                return false;
+            }
+            if (arg == "--max-open") {
+                options.tree.max_open_files = value;
+            } else if (arg == "--buffers") {
+                options.tree.buffers = value;
+            } else {
+                options.tree.chunk_size = value;
+            }
+        } else if (arg == "-a" && i + 1 < argc && strcmp(argv[i + 1], "both") == 0) {
+            options.hash_bits = file_hash::pair_bits;
+            i++;
+        } else if ((arg == "-a" || arg == "-j") && i + 1 < argc) {
+            auto value = strtoul(argv[++i], nullptr, 10);
+            if (arg == "-a") {
+                if (value != 256 && value != 512) {
+                    std::cerr << argv[0] << ": unsupported digest size " << argv[i] << std::endl;
+                    return false;
+                }
+                options.hash_bits = value;
+            } else {
+                options.threads = value;
+            }
+        } else {
+            std::cerr << argv[0] << ": unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    if (options.hash_bits == file_hash::pair_bits && (options.recursive || options.merkle || options.records)) {
+        std::cerr << argv[0] << ": -a both is supported only for plain file digests" << std::endl;
+        return false;
+    }
+    if (options.cache_path.empty() && (options.cache_policy.trust || options.compact_cache)) {
+        std::cerr << argv[0] << ": --trust-cache, --verify-sample and --compact-cache need --cache" << std::endl;
+        return false;
+    }
+    if (!options.cache_path.empty() &&
+        (options.check || options.merkle || options.records || options.hash_bits == file_hash::pair_bits)) {
+        std::cerr << argv[0] << ": --cache is supported only for plain and -r digests" << std::endl;
+        return false;
+    }
+    if (options.paths.empty()) {
+        options.paths.emplace_back(options.recursive ? "." : "-");
+    }
+    return true;
+}
+
+/**
+ * Печатает строки результатов в исходном порядке по мере того, как готов их префикс.
+ */
+class Ordered_output {
+public:
+    explicit Ordered_output(size_t count) : lines_(count), ready_(count, false), to_stderr_(count, false) {
+    }
+
+    void set(size_t index, std::string line, bool to_stderr = false) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lines_[index] = std::move(line);
+        ready_[index] = true;
+        to_stderr_[index] = to_stderr;
+        while (next_ < lines_.size() && ready_[next_]) {
+            auto &stream = to_stderr_[next_] ? std::cerr : std::cout;
+            stream << lines_[next_];
+            lines_[next_].clear();
+            next_++;
+        }
+    }
+
+private:
+
+    std::vector<std::string> lines_;
+    std::vector<bool> ready_;
+    std::vector<bool> to_stderr_;
+    size_t next_ = 0;
+    std::mutex mutex_;
+};
+
+/**
+ * "<digest>  <path>\n": hex записывается прямо в строку, без промежуточных строк на каждый дайджест.
+ */
+void append_digest_line(std::string &line, const uint8_t *digest, size_t digest_size, const std::string &path) {
+    auto offset = line.size();
+    line.resize(offset + 2 * digest_size);
+    hex::encode(digest, digest_size, &line[offset]);
+    line += "  ";
+    line += path;
+    line += '\n';
+}
+
+int compute_tree(const char *program, const Options &options, digest_cache::Cache *cache) {
+    auto tree_options = options.tree;
+    tree_options.hash_bits = options.hash_bits;
+    tree_options.threads = options.threads;
+    tree_options.cache = cache;
+
+    std::string line;
+    auto report = dir_hasher::hash_tree(options.paths, tree_options, [&](const std::string &path,
+                                                                        const uint8_t *digest,
+                                                                        const std::string &error) {
+        if (digest == nullptr) {
+            std::cerr << program << ": " << path << ": " << error << std::endl;
+            return;
+        }
+        if (!error.empty()) {
+            std::cerr << program << ": WARNING: " << path << ": " << error << std::endl;
+        }
+        line.clear();
+        append_digest_line(line, digest, options.hash_bits / 8, path);
+        std::cout << line;
+    });
+    std::cout.flush();
+
+    if (options.report) {
+        dir_hasher::print_report(report);
+    }
+    return report.failed > 0 ? 1 : 0;
+}
+
+std::string tree_label(const Options &options) {
+    return "TREE-STREEBOG" + std::to_string(options.hash_bits) + "/" + std::to_string(options.leaf_size);
+}
+
+/**
+ * Читает строки "<index> <offset> <length> <digest>", записанные --leaves. Смещение и длина
+ * проверяются по leaf_size: файл листьев с другим размером листа иначе дал бы ложные FAILED.
+ */
+bool read_leaves(const std::string &path, size_t digest_size, uint64_t leaf_size, std::vector<uint8_t> &leaves,
+                 std::string &error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = strerror(errno);
+        return false;
+    }
+    size_t index;
+    uint64_t offset, length, previous_length = leaf_size;
+    std::string text;
+    while (file >> index >> offset >> length >> text) {
+        auto expected = leaves.size() / digest_size;
+        if (index != expected) {
+            error = "leaf lines are out of order";
+            return false;
+        }
+        if (offset != (uint64_t)index * leaf_size) {
+            error = "leaf " + std::to_string(index) + " starts at " + std::to_string(offset) + ", expected " +
+                    std::to_string((uint64_t)index * leaf_size) + " for leaf size " + std::to_string(leaf_size);
+            return false;
+        }
+        // короче листа может быть только последний лист, пустым -- только единственный
+        if (previous_length != leaf_size || length > leaf_size || (length == 0 && index != 0)) {
+            error = "leaf " + std::to_string(previous_length != leaf_size ? index - 1 : index) +
+                    " has length " + std::to_string(previous_length != leaf_size ? previous_length : length) +
+                    ", expected " + std::to_string(leaf_size) + " or a shorter final leaf";
+            return false;
+        }
+        previous_length = length;
+        leaves.resize(leaves.size() + digest_size);
+        if (text.size() != 2 * digest_size ||
+            !hex::decode(text.data(), digest_size, leaves.data() + leaves.size() - digest_size)) {
+            error = "malformed digest of leaf " + std::to_string(index);
+            return false;
+        }
+    }
+    if (!file.eof() || leaves.empty()) {
+        error = "malformed leaf line " + std::to_string(leaves.size() / digest_size);
+        return false;
+    }
+    return true;
+}
+
+int verify_merkle_leaves(const char *program, const Options &options, const tree_mode::Options &tree_options) {
+    const size_t digest_size = options.hash_bits / 8;
+    if (options.paths.size() != 1) {
+        std::cerr << program << ": --verify-leaves needs exactly one FILE" << std::endl;
+        return 2;
+    }
+    const auto &path = options.paths[0];
+
+    std::vector<uint8_t> leaves;
+    std::vector<size_t> mismatched;
+    std::string error;
+    if (!read_leaves(options.verify_leaves_path, digest_size, options.leaf_size, leaves, error)) {
+        std::cerr << program << ": " << options.verify_leaves_path << ": " << error << std::endl;
+        return 1;
+    }
+    if (!tree_mode::verify_path(path, leaves, options.range_offset, options.range_length, tree_options,
+                                mismatched, error)) {
+        std::cerr << program << ": " << path << ": " << error << std::endl;
+        return 1;
+    }
+
+    for (auto index : mismatched) {
+        std::cout << path << ": leaf " << index << " at offset " << (uint64_t)index * options.leaf_size
+                  << ": FAILED" << std::endl;
+    }
+    if (mismatched.empty()) {
+        std::cout << path << ": leaves OK" << std::endl;
+    }
+    return mismatched.empty() ? 0 : 1;
+}
+
+int compute_merkle(const char *program, const Options &options) {
+    tree_mode::Options tree_options;
+    tree_options.hash_bits = options.hash_bits;
+    tree_options.leaf_size = options.leaf_size;
+    tree_options.threads = options.threads;
+
+    if (!options.verify_leaves_path.empty()) {
+        return verify_merkle_leaves(program, options, tree_options);
+    }
+
+    std::ofstream leaves_file;
+    if (!options.leaves_path.empty()) {
+        leaves_file.open(options.leaves_path);
+        if (!leaves_file) {
+            std::cerr << program << ": " << options.leaves_path << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+
+    const size_t digest_size = options.hash_bits / 8;
+    int status = 0;
+    for (const auto &path : options.paths) {
+        tree_mode::Result result;
+        std::string error;
+        if (!tree_mode::hash_path(path, tree_options, result, error)) {
+            std::cerr << program << ": " << path << ": " << error << std::endl;
+            status = 1;
+            continue;
+        }
+        std::cout << tree_label(options) << " (" << path << ") = "
+                  << utils::bytes_to_hex(result.root.data(), digest_size) << std::endl;
+
+        if (leaves_file.is_open()) {
+            auto count = result.leaves.size() / digest_size;
+            for (size_t index = 0; index < count; index++) {
+                auto offset = (uint64_t)index * options.leaf_size;
+                leaves_file << index << " " << offset << " "
+                            << std::min<uint64_t>(options.leaf_size, result.length - offset) << " "
+                            << utils::bytes_to_hex(result.leaves.data() + index * digest_size, digest_size)
+                            << "\n";
+            }
+        }
+    }
+    return status;
+}
+
+bool write_all(int fd, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        auto written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ * Обычные файлы отображаются в память, каналы и стандартный ввод читаются окнами.
+ */
+bool hash_record_file(const std::string &path, const records::Options &record_options, records::Report &report,
+                      std::string &error) {
+    int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = strerror(errno);
+        return false;
+    }
+    auto sink = [](const uint8_t *output, size_t size) {
+        return write_all(STDOUT_FILENO, output, size);
+    };
+    struct stat info;
+    file_hash::Mapped_file file;
+    bool ok;
+    if (fstat(fd, &info) != 0) {
+        error = strerror(errno);
+        ok = false;
+    } else if (S_ISREG(info.st_mode) && info.st_size > 0 && file.map(fd, (size_t)info.st_size)) {
+        ok = records::hash_records(file.data(), file.size(), record_options, sink, report, error);
+    } else {
+        ok = records::hash_stream(fd, record_options, sink, report, error);
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return ok;
+}
+
+int compute_records(const char *program, const Options &options) {
+    auto record_options = options.record_options;
+    record_options.hash_bits = options.hash_bits;
+    record_options.threads = options.threads;
+
+    int status = 0;
+    records::Report report;
+    for (const auto &path : options.paths) {
+        std::string error;
+        if (!hash_record_file(path, record_options, report, error)) {
+            std::cerr << program << ": " << path << ": " << error << std::endl;
+            status = 1;
+        }
+    }
+    if (options.report) {
+        auto seconds = std::max(report.seconds, 1e-9);
+        std::cerr << "records: " << report.records << ", " << report.bytes << " bytes in " << report.seconds
+                  << " s" << std::endl
+                  << "throughput: " << report.bytes / seconds / (1 << 20) << " MiB/s, "
+                  << report.records / seconds << " records/s (scanner " << records::scanner_name() << ")"
+                  << std::endl;
+    }
+    return status;
+}
+
+/**
+ * hash_path через кэш: stat до чтения даёт ключ, изменение файла во время хеширования меняет ctime,
+ * и записанный под старым ключом дайджест больше не найдётся. changed -- дайджест не совпал
+ * с кэшированным, хотя метаданные файла те же.
+ */
+bool hash_path_cached(const std::string &path, size_t hash_bits, digest_cache::Cache *cache, uint8_t *out,
+                      bool &changed, std::string &error) {
+    changed = false;
+    struct stat info;
+    if (cache == nullptr || path == "-" || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return file_hash::hash_path(path, hash_bits, out, error);
+    }
+    auto key = digest_cache::key_of(info);
+    uint8_t expected[digest_cache::max_digest_size];
+    auto found = cache->lookup(key, hash_bits, expected);
+    if (found == digest_cache::hit) {
+        memcpy(out, expected, hash_bits / 8);
+        return true;
+    }
+    if (!file_hash::hash_path(path, hash_bits, out, error)) {
+        return false;
+    }
+    changed = !cache->record(key, hash_bits, out, found == digest_cache::verify ? expected : nullptr);
+    return true;
+}
+
+int compute(const char *program, const Options &options, digest_cache::Cache *cache) {
+    if (options.records) {
+        return compute_records(program, options);
+    }
+    if (options.merkle) {
+        return compute_merkle(program, options);
+    }
+    if (options.recursive) {
+        return compute_tree(program, options, cache);
+    }
+
+    Ordered_output output(options.paths.size());
+    std::atomic<size_t> failed(0);
+
+    Thread_pool pool(options.threads);
+    for (size_t i = 0; i < options.paths.size(); i++) {
+        pool.submit([&, i] {
+            const auto &path = options.paths[i];
+            uint8_t digest[Streebog_pair::digest_size];
+            std::string error;
+            bool changed;
+            if (hash_path_cached(path, options.hash_bits, cache, digest, changed, error)) {
+                if (changed) {
+                    std::cerr << std::string(program) + ": WARNING: " + path +
+                                 ": content changed without a change in size, mtime or ctime\n";
+                }
+                std::string line;
+                if (options.hash_bits == file_hash::pair_bits) {
+                    // две строки обычного формата, такой вывод проверяется через -c
+                    append_digest_line(line, digest, Streebog_256::digest_size, path);
+                    append_digest_line(line, digest + Streebog_256::digest_size, Streebog_512::digest_size, path);
+                } else {
+                    append_digest_line(line, digest, options.hash_bits / 8, path);
+                }
+                output.set(i, std::move(line));
+            } else {
+                failed++;
+                output.set(i, std::string(program) + ": " + path + ": " + error + "\n", true);
+            }
+        });
+    }
+    pool.wait();
+
+    return failed > 0 ? 1 : 0;
+}
+
+struct Manifest_entry {
+    std::string path;
+    size_t hash_bits;
+    uint8_t digest[64];
+};
+
+/**
+ * Строка манифеста: "<digest>  <file>" или "<digest> *<file>".
+ */
+bool parse_manifest_line(const std::string &line, Manifest_entry &entry) {
+    auto space = line.find(' ');
+    if (space == std::string::npos || space + 2 > line.length()) {
+        return false;
+    }
+    if (space != 64 && space != 128) {
+        return false;
+    }
+    entry.hash_bits = space * 4;
+    if (!hex::decode(line.data(), entry.hash_bits / 8, entry.digest)) {
+        return false;
+    }
+    if (line[space + 1] != ' ' && line[space + 1] != '*') {
+        return false;
+    }
+    entry.path = line.substr(space + 2);
+    return !entry.path.empty();
+}
+
+int check(const char *program, const Options &options) {
+    std::vector<Manifest_entry> entries;
+    size_t malformed = 0;
+    for (const auto &manifest : options.paths) {
+        std::ifstream file;
+        std::istream *input = &std::cin;
+        if (manifest != "-") {
+            file.open(manifest);
+            if (!file) {
+                std::cerr << program << ": " << manifest << ": " << strerror(errno) << std::endl;
+                return 1;
+            }
+            input = &file;
+        }
+
+        std::string line;
+        while (std::getline(*input, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            Manifest_entry entry;
+            if (parse_manifest_line(line, entry)) {
+                entries.push_back(std::move(entry));
+            } else {
+                malformed++;
+            }
+        }
+    }
+
+    Ordered_output output(entries.size());
+    std::atomic<size_t> mismatched(0);
+    std::atomic<size_t> unreadable(0);
+
+    Thread_pool pool(options.threads);
+    for (size_t i = 0; i < entries.size(); i++) {
+        pool.submit([&, i] {
+            const auto &entry = entries[i];
+            uint8_t digest[64];
+            std::string error;
+            if (!file_hash::hash_path(entry.path, entry.hash_bits, digest, error)) {
+                unreadable++;
+                output.set(i, std::string(program) + ": " + entry.path + ": " + error + "\n" +
+                              entry.path + ": FAILED open or read\n", true);
+            } else if (memcmp(digest, entry.digest, entry.hash_bits / 8) != 0) {
+                mismatched++;
+                output.set(i, entry.path + ": FAILED\n");
+            } else {
+                output.set(i, options.quiet ? std::string() : entry.path + ": OK\n");
+            }
+        });
+    }
+    pool.wait();
+
+    if (malformed > 0) {
+        std::cerr << program << ": WARNING: " << malformed << " line(s) are improperly formatted" << std::endl;
+    }
+    if (unreadable > 0) {
+        std::cerr << program << ": WARNING: " << unreadable << " listed file(s) could not be read" << std::endl;
+    }
+    if (mismatched > 0) {
+        std::cerr << program << ": WARNING: " << mismatched << " computed checksum(s) did NOT match" << std::endl;
+    }
+    return (mismatched > 0 || unreadable > 0 || entries.empty()) ? 1 : 0;
+}
+
+/**
+ * Сводка по кэшу, сжатие и закрытие; 1, если дайджест файла с неизменными метаданными не совпал
+ * с сохранённым -- содержимое поменялось в обход mtime/ctime или повреждено.
+ */
+int finish_cache(const char *program, const Options &options, digest_cache::Cache &cache) {
+    auto counters = cache.counters();
+    std::string error = cache.error();
+    if (!error.empty()) {
+        std::cerr << program << ": WARNING: cache was not updated: " << error << std::endl;
+    }
+    if (options.compact_cache && !cache.compact(error)) {
+        std::cerr << program << ": WARNING: cache was not compacted: " << error << std::endl;
+    }
+    if (!cache.close(error)) {
+        std::cerr << program << ": WARNING: " << error << std::endl;
+    }
+    if (options.report) {
+        std::cerr << "cache: " << counters.hits << " hits, " << counters.verified << " rehashed and compared, "
+                  << counters.misses << " misses, " << counters.stored << " stored, " << counters.entries
+                  << " entries" << std::endl;
+    }
+    if (counters.mismatches > 0) {
+        std::cerr << program << ": WARNING: " << counters.mismatches
+                  << " file(s) changed without a change in size, mtime or ctime" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+};
+
+int run(int argc, char **argv) {
+    Options options;
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        print_usage(argv[0]);
+        return 0;
+    }
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    digest_cache::Cache cache;
+    if (!options.cache_path.empty()) {
+        std::string error;
+        if (!cache.open(options.cache_path, options.cache_policy, error)) {
+            std::cerr << argv[0] << ": " << error << std::endl;
+            return 1;
+        }
+    }
+    auto cache_in_use = options.cache_path.empty() ? nullptr : &cache;
+    auto status = options.check ? check(argv[0], options) : compute(argv[0], options, cache_in_use);
+    if (cache_in_use != nullptr && finish_cache(argv[0], options, cache) != 0) {
+        status = 1;
+    }
+    if (options.stats) {
+        stats::print(stats::snapshot(), std::cerr);
+    }
+    return status;
+}
+
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+/**
+ * Утилита в духе gostsum: хеширование файлов и проверка списков контрольных сумм.
+ */
+namespace sum_tool {
+
+int run(int argc, char **argv);
+
+};
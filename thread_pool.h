@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Простой пул потоков с общей очередью задач.
+ */
+class Thread_pool {
+public:
+    explicit Thread_pool(size_t threads = 0) {
+        if (threads == 0) {
+            threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        // если поток создать не удалось, уже запущенные нужно остановить: иначе деструктор
+        // std::thread вызовет std::terminate и исключение не дойдёт до вызывающего
+        try {
+            for (size_t i = 0; i < threads; i++) {
+                workers_.emplace_back([this] { work(); });
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    Thread_pool(const Thread_pool &) = delete;
+    Thread_pool &operator=(const Thread_pool &) = delete;
+
+    ~Thread_pool() {
+        stop();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+            pending_++;
+        }
+        has_tasks_.notify_one();
+    }
+
+    /**
+     * Ждёт завершения всех отправленных задач.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    size_t size() const {
+        return workers_.size();
+    }
+
+private:
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        has_tasks_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                has_tasks_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+
+            task();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) {
+                idle_.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    std::condition_variable idle_;
+    size_t pending_ = 0;
+    bool stopping_ = false;
+};
@@ -0,0 +1,333 @@
+#include "tree_mode.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_hash.h"
+#include "stats.h"
+#include "streebog.h"
+#include "thread_pool.h"
+
+namespace tree_mode {
+
+namespace {
+
+enum Domain : uint8_t {
+    leaf_domain = 0x00,
+    node_domain = 0x01,
+    root_domain = 0x02
+};
+
+void store_le64(uint8_t *out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+template<size_t hash_bits>
+void digest_with_suffix(const uint8_t *data, size_t length, const uint8_t *suffix, size_t suffix_length,
+                        uint8_t *out) {
+    Streebog<hash_bits> context;
+    context.update(data, length);
+    context.update(suffix, suffix_length);
+    context.final(out);
+}
+
+void digest_with_suffix(size_t hash_bits, const uint8_t *data, size_t length, const uint8_t *suffix,
+                        size_t suffix_length, uint8_t *out) {
+    if (hash_bits == 256) {
+        digest_with_suffix<256>(data, length, suffix, suffix_length, out);
+    } else {
+        digest_with_suffix<512>(data, length, suffix, suffix_length, out);
+    }
+}
+
+void leaf_digest(size_t hash_bits, const uint8_t *data, size_t length, uint64_t index, uint8_t *out) {
+    uint8_t suffix[9] = {leaf_domain};
+    store_le64(suffix + 1, index);
+    digest_with_suffix(hash_bits, data, length, suffix, sizeof(suffix), out);
+}
+
+size_t leaf_length(uint64_t length, size_t leaf_size, size_t index) {
+    auto offset = (uint64_t)index * leaf_size;
+    return (size_t)std::min<uint64_t>(leaf_size, length - offset);
+}
+
+/**
+ * Ограничивает число листьев, прочитанных из потока, но ещё не захешированных.
+ */
+class Slots {
+public:
+    explicit Slots(size_t count) : available_(count) {
+    }
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this] { return available_ > 0; });
+        available_--;
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            available_++;
+        }
+        released_.notify_one();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    size_t available_;
+};
+
+bool read_full(int fd, uint8_t *buffer, size_t length, size_t &filled, std::string &error) {
+    STRIBOG_STATS_TIME(io);
+    filled = 0;
+    while (filled < length) {
+        auto result = read(fd, buffer + filled, length - filled);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = strerror(errno);
+            return false;
+        }
+        if (result == 0) {
+            break;
+        }
+        filled += (size_t)result;
+    }
+    return true;
+}
+
+/**
+ * Читает поток по листу и хеширует листья в пуле; в памяти не больше 2 * threads листьев.
+ */
+bool hash_stream(int fd, const Options &options, Result &result, std::string &error) {
+    const size_t digest_size = options.hash_bits / 8;
+    Thread_pool pool(options.threads);
+    Slots slots(2 * pool.size());
+    std::mutex leaves_mutex;
+
+    result.leaves.clear();
+    result.length = 0;
+    bool ok = true;
+    for (size_t index = 0;; index++) {
+        slots.acquire();
+        std::shared_ptr<std::vector<uint8_t> > buffer(new std::vector<uint8_t>(options.leaf_size));
+        size_t filled;
+        ok = read_full(fd, buffer->data(), options.leaf_size, filled, error);
+        if (!ok || (filled == 0 && index > 0)) {
+            slots.release();
+            break;
+        }
+        result.length += filled;
+        {
+            std::lock_guard<std::mutex> lock(leaves_mutex);
+            result.leaves.resize((index + 1) * digest_size);
+        }
+        pool.submit([&, buffer, filled, index] {
+            uint8_t digest[64];
+            leaf_digest(options.hash_bits, buffer->data(), filled, index, digest);
+            {
+                std::lock_guard<std::mutex> lock(leaves_mutex);
+                memcpy(result.leaves.data() + index * digest_size, digest, digest_size);
+            }
+            slots.release();
+        });
+        if (filled < options.leaf_size) {
+            break;
+        }
+    }
+    pool.wait();
+
+    if (ok) {
+        result.root = root_from_leaves(result.leaves, result.length, options);
+    }
+    return ok;
+}
+
+bool open_input(const std::string &path, int &fd, std::string &error) {
+    fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void close_input(const std::string &path, int fd) {
+    if (path != "-") {
+        close(fd);
+    }
+}
+
+};
+
+std::vector<uint8_t> root_from_leaves(const std::vector<uint8_t> &leaves, uint64_t length, const Options &options) {
+    const size_t digest_size = options.hash_bits / 8;
+
+    std::vector<uint8_t> level = leaves;
+    std::vector<uint8_t> next;
+    uint8_t node_input[2 * 64];
+    const uint8_t node_suffix[1] = {node_domain};
+    while (level.size() > digest_size) {
+        auto count = level.size() / digest_size;
+        next.resize((count + 1) / 2 * digest_size);
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            memcpy(node_input, level.data() + i * digest_size, 2 * digest_size);
+            digest_with_suffix(options.hash_bits, node_input, 2 * digest_size, node_suffix, 1,
+                               next.data() + i / 2 * digest_size);
+        }
+        if (count % 2 == 1) {
+            memcpy(next.data() + count / 2 * digest_size, level.data() + (count - 1) * digest_size, digest_size);
+        }
+        level.swap(next);
+    }
+
+    uint8_t root_suffix[17] = {};
+    store_le64(root_suffix, length);
+    store_le64(root_suffix + 8, options.leaf_size);
+    root_suffix[16] = root_domain;
+
+    std::vector<uint8_t> root(digest_size);
+    digest_with_suffix(options.hash_bits, level.data(), digest_size, root_suffix, sizeof(root_suffix), root.data());
+    return root;
+}
+
+Result hash(const uint8_t *data, uint64_t length, const Options &options) {
+    const size_t digest_size = options.hash_bits / 8;
+    const size_t count = leaf_count(length, options.leaf_size);
+
+    Result result;
+    result.length = length;
+    result.leaves.resize(count * digest_size);
+
+    Thread_pool pool(std::min(options.threads == 0 ? std::thread::hardware_concurrency() : options.threads, count));
+    for (size_t index = 0; index < count; index++) {
+        pool.submit([&, index] {
+            leaf_digest(options.hash_bits, data + (uint64_t)index * options.leaf_size,
+                        leaf_length(length, options.leaf_size, index), index,
+                        result.leaves.data() + index * digest_size);
+        });
+    }
+    pool.wait();
+
+    result.root = root_from_leaves(result.leaves, length, options);
+    return result;
+}
+
+bool verify_range(const uint8_t *data, uint64_t length, const std::vector<uint8_t> &leaves, uint64_t offset,
+                  uint64_t range_length, const Options &options, std::vector<size_t> &mismatched,
+                  std::string &error) {
+    const size_t digest_size = options.hash_bits / 8;
+    const size_t count = leaf_count(length, options.leaf_size);
+
+    if (offset >= std::max<uint64_t>(length, 1)) {
+        error = "range offset " + std::to_string(offset) + " is past the end (" + std::to_string(length) +
+                " bytes)";
+        return false;
+    }
+    if (leaves.size() != count * digest_size) {
+        // другое число листьев -- длина изменилась, совпадения по номерам не имеют смысла
+        for (size_t index = 0; index < count; index++) {
+            mismatched.push_back(index);
+        }
+        return true;
+    }
+
+    size_t first = (size_t)(offset / options.leaf_size);
+    auto end = range_length > UINT64_MAX - offset ? UINT64_MAX : offset + range_length;
+    size_t last = range_length == 0 ? first : (size_t)std::min<uint64_t>((end - 1) / options.leaf_size, count - 1);
+
+    std::vector<uint8_t> differs(count, 0);
+    Thread_pool pool(std::min<size_t>(options.threads == 0 ? std::thread::hardware_concurrency() : options.threads,
+                                      last - first + 1));
+    for (size_t index = first; index <= last; index++) {
+        pool.submit([&, index] {
+            uint8_t digest[64];
+            leaf_digest(options.hash_bits, data + (uint64_t)index * options.leaf_size,
+                        leaf_length(length, options.leaf_size, index), index, digest);
+            differs[index] = memcmp(digest, leaves.data() + index * digest_size, digest_size) != 0;
+        });
+    }
+    pool.wait();
+
+    for (size_t index = first; index <= last; index++) {
+        if (differs[index]) {
+            mismatched.push_back(index);
+        }
+    }
+    return true;
+}
+
+bool hash_path(const std::string &path, const Options &options, Result &result, std::string &error) {
+    int fd;
+    if (!open_input(path, fd, error)) {
+        return false;
+    }
+
+    bool ok;
+    struct stat info;
+    file_hash::Mapped_file file;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && file.map(fd, (size_t)info.st_size)) {
+        result = hash(file.data(), file.size(), options);
+        ok = true;
+    } else {
+        ok = hash_stream(fd, options, result, error);
+    }
+    close_input(path, fd);
+    return ok;
+}
+
+bool verify_path(const std::string &path, const std::vector<uint8_t> &leaves, uint64_t offset,
+                 uint64_t range_length, const Options &options, std::vector<size_t> &mismatched,
+                 std::string &error) {
+    int fd;
+    if (!open_input(path, fd, error)) {
+        return false;
+    }
+
+    bool ok = true;
+    struct stat info;
+    file_hash::Mapped_file file;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && file.map(fd, (size_t)info.st_size)) {
+        ok = verify_range(file.data(), file.size(), leaves, offset, range_length, options, mismatched, error);
+    } else if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size == 0) {
+        ok = verify_range(nullptr, 0, leaves, offset, range_length, options, mismatched, error);
+    } else {
+        // поток нельзя прочитать выборочно -- хешируем целиком и сравниваем все листья
+        Result result;
+        ok = hash_stream(fd, options, result, error);
+        if (ok && offset >= std::max<uint64_t>(result.length, 1)) {
+            error = "range offset " + std::to_string(offset) + " is past the end (" + std::to_string(result.length) +
+                    " bytes)";
+            ok = false;
+        }
+        if (ok) {
+            const size_t digest_size = options.hash_bits / 8;
+            auto count = result.leaves.size() / digest_size;
+            for (size_t index = 0; index < count; index++) {
+                if (leaves.size() != result.leaves.size() ||
+                    memcmp(result.leaves.data() + index * digest_size, leaves.data() + index * digest_size,
+                           digest_size) != 0) {
+                    mismatched.push_back(index);
+                }
+            }
+        }
+    }
+    close_input(path, fd);
+    return ok;
+}
+
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Древовидный (Merkle) режим -- НЕ стандартный хеш ГОСТ Р 34.11-2012.
+ *
+ * Вход делится на листья по leaf_size байт, листья хешируются Streebog параллельно, затем
+ * попарно сворачиваются в корень. Все узлы разделены по доменам суффиксом:
+ *
+ *     leaf(i)        = H(data_i || 0x00 || le64(i))
+ *     node(l, r)     = H(l || r || 0x01)             (нечётный последний узел поднимается как есть)
+ *     root           = H(top || le64(length) || le64(leaf_size) || 0x02)
+ *
+ * Суффикс, а не префикс, сохраняет выравнивание данных листа по блокам, и они хешируются без копирования.
+ * Результат зависит от leaf_size, поэтому размер листа выводится вместе с корнем.
+ */
+namespace tree_mode {
+
+struct Options {
+    size_t hash_bits = 256;
+    size_t leaf_size = 1 << 20;
+    size_t threads = 0;
+};
+
+struct Result {
+    std::vector<uint8_t> root;
+    std::vector<uint8_t> leaves;     // leaf_count() * digest_size байт подряд
+    uint64_t length = 0;
+};
+
+inline size_t leaf_count(uint64_t length, size_t leaf_size) {
+    return length == 0 ? 1 : (size_t)((length + leaf_size - 1) / leaf_size);
+}
+
+Result hash(const uint8_t *data, uint64_t length, const Options &options);
+
+/**
+ * Корень по уже известным хешам листьев.
+ */
+std::vector<uint8_t> root_from_leaves(const std::vector<uint8_t> &leaves, uint64_t length, const Options &options);
+
+/**
+ * Пересчитывает только листья, пересекающие [offset, offset + range_length), и добавляет
+ * в mismatched номера тех, чьи хеши не совпали с leaves. false -- offset за концом данных
+ * (у пустых данных допустим только 0).
+ */
+bool verify_range(const uint8_t *data, uint64_t length, const std::vector<uint8_t> &leaves, uint64_t offset,
+                  uint64_t range_length, const Options &options, std::vector<size_t> &mismatched,
+                  std::string &error);
+
+/**
+ * То же для файла: большие файлы отображаются в память, остальное (каналы, stdin) читается по листу.
+ */
+bool hash_path(const std::string &path, const Options &options, Result &result, std::string &error);
+
+bool verify_path(const std::string &path, const std::vector<uint8_t> &leaves, uint64_t offset,
+                 uint64_t range_length, const Options &options, std::vector<size_t> &mismatched,
+                 std::string &error);
+
+};
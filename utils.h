@@ -7,29 +7,49 @@
 #include <cstring>
 #include <algorithm>
 
+#include "hex.h"
+
 using block_t = uint8_t*;
 
 namespace utils {
 
+constexpr uint8_t hex_digit(char chr) {
+    if (chr >= '0' && chr <= '9') {
+        return (uint8_t)(chr - '0');
+    }
+    if (chr >= 'A' && chr <= 'F') {
+        return (uint8_t)(chr - 'A' + 10);
+    }
+    return (uint8_t)(chr - 'a' + 10);
+}
+
 template<typename T>
 T parse_hex(const std::string& hex_str) {
     size_t size = std::min(hex_str.length(), sizeof(T) * 2);
 
     T result = 0;
     for (size_t i = 0; i < size; i++) {
-        const auto& chr = (char)tolower(hex_str[i]);
         result <<= 4;
-        if (isdigit(chr)) {
-            result |= (uint8_t)(chr - '0');
-        } else {
-            result |= (uint8_t)(chr - 'a' + 10);
-        }
+        result |= hex_digit(hex_str[i]);
     }
     return result;
 }
 
+/**
+ * constexpr-вариант parse_hex: разбирает ровно length символов, годится для таблиц времени компиляции.
+ */
 template<typename T>
-void print_hex(T value, std::string message="", bool need_flush=true) {
+constexpr T parse_hex(const char* hex_str, size_t length) {
+    T result = 0;
+    for (size_t i = 0; i < length; i++) {
+        result <<= 4;
+        result |= hex_digit(hex_str[i]);
+    }
+    return result;
+}
+
+template<typename T>
+std::string to_hex(T value) {
     size_t size = sizeof(T);
 
     auto convert_to_hex = [](int x) {
@@ -50,6 +70,29 @@ void print_hex(T value, std::string message="", bool need_flush=true) {
     }
 
     std::reverse(result.begin(), result.end());
+    return result;
+}
+
+/**
+ * Байты в порядке хранения, два символа на байт (формат дайджестов утилиты).
+ * На массовых путях лучше hex::encode прямо в буфер вывода.
+ */
+inline std::string bytes_to_hex(const uint8_t* data, size_t length) {
+    std::string result(2 * length, '0');
+    hex::encode(data, length, &result[0]);
+    return result;
+}
+
+/**
+ * Обратное к bytes_to_hex; false, если строка не является hex-записью ровно length байт.
+ */
+inline bool hex_to_bytes(const std::string& hex_str, uint8_t* out, size_t length) {
+    return hex_str.length() == 2 * length && hex::decode(hex_str.data(), length, out);
+}
+
+template<typename T>
+void print_hex(T value, std::string message="", bool need_flush=true) {
+    auto result = to_hex(value);
     if (!message.empty()) {
         std::cout << message << "\t:\t";
     }
@@ -69,7 +112,7 @@ void print_hex_array(const T &arr, const std::string& msg="", int level=0) {
 }
 
 template<>
-void print_hex_array(const __uint128_t &arr, const std::string& msg, int level) {
+inline void print_hex_array(const __uint128_t &arr, const std::string& msg, int level) {
     std::string local_msg;
     for (int i = 0; i < level; i++) {
         local_msg += "\t";
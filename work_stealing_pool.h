@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Пул потоков с очередью на каждый поток и кражей работы.
+ *
+ * Задача, отправленная из рабочего потока, попадает в его собственную очередь и берётся оттуда
+ * в порядке LIFO (данные ещё в кеше); задачи извне раскладываются по очередям по кругу.
+ * Поток без работы забирает самую старую задачу из чужой очереди.
+ */
+class Work_stealing_pool {
+public:
+    explicit Work_stealing_pool(size_t threads = 0) {
+        if (threads == 0) {
+            threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threads; i++) {
+            queues_.emplace_back(new Queue());
+        }
+        for (size_t i = 0; i < threads; i++) {
+            workers_.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    Work_stealing_pool(const Work_stealing_pool &) = delete;
+    Work_stealing_pool &operator=(const Work_stealing_pool &) = delete;
+
+    ~Work_stealing_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        has_tasks_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void submit(std::function<void()> task) {
+        size_t index = current_worker() == this ? current_index() : next_queue_++ % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            queued_++;
+            pending_++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        has_tasks_.notify_one();
+    }
+
+    /**
+     * Ждёт завершения всех отправленных задач, включая порождённые ими.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    /**
+     * Число задач, ожидающих выполнения во всех очередях.
+     */
+    size_t queued() {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        return queued_;
+    }
+
+    size_t size() const {
+        return workers_.size();
+    }
+
+    uint64_t steals() const {
+        return steals_;
+    }
+
+private:
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    static Work_stealing_pool *&current_worker() {
+        static thread_local Work_stealing_pool *pool = nullptr;
+        return pool;
+    }
+
+    static size_t &current_index() {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+    bool pop_own(size_t index, std::function<void()> &task) {
+        auto &queue = *queues_[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t index, std::function<void()> &task) {
+        for (size_t offset = 1; offset < queues_.size(); offset++) {
+            auto &queue = *queues_[(index + offset) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                steals_++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t index) {
+        current_worker() = this;
+        current_index() = index;
+
+        while (true) {
+            std::function<void()> task;
+            if (pop_own(index, task) || steal(index, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(sleep_mutex_);
+                    queued_--;
+                }
+                task();
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                if (--pending_ == 0) {
+                    idle_.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            has_tasks_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+            if (stopping_ && queued_ == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue> > queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_queue_{0};
+    std::atomic<uint64_t> steals_{0};
+
+    std::mutex sleep_mutex_;
+    std::condition_variable has_tasks_;
+    std::condition_variable idle_;
+    size_t queued_ = 0;
+    size_t pending_ = 0;
+    bool stopping_ = false;
+};